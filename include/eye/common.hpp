@@ -11,5 +11,17 @@ namespace eye {
     typedef std::pair<mode_map_t, image_data_t> mode_pair_t;
     typedef andres::Marray<unsigned int> image_array_t;
     typedef std::vector<mode_map_t> mode_array_t;
+
+    /**
+     * How a histogram chooses its mode when several values share the highest
+     * count.
+     */
+    enum class TieBreak {
+        // The value that reached the highest count first, in counting order.
+        FIRST_REACHED,
+        // The smallest non-zero value, regardless of counting order. Zero
+        // only wins if no other value ties with it.
+        SMALLEST_NONZERO
+    };
 }
 #endif
@@ -5,5 +5,11 @@
 
 namespace eye {
     const unsigned int MAX_WORK_THREADS = std::thread::hardware_concurrency();
+    // Number of elements generated per task when filling synthetic images.
+    const std::size_t FILL_BLOCK_SIZE = 1 << 16;
+    // Number of output elements computed per task when downsampling.
+    const std::size_t DOWNSAMPLE_BLOCK_SIZE = 1 << 12;
+    // Minimum number of independent subtrees a Morton pyramid is split into.
+    const std::size_t MORTON_MIN_SUBTREES = 256;
 }
 #endif
@@ -1,25 +1,61 @@
 #ifndef EYE_FUNCTIONS_HPP
 #define EYE_FUNCTIONS_HPP
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <eye/common.hpp>
 #include <eye/image.hpp>
+#include <eye/memory.hpp>
+#include <eye/morton.hpp>
+#include <eye/random.hpp>
+#include <eye/thread_pool.hpp>
 
 namespace eye {
     typedef std::pair<Image, std::vector<mode_map_t>> image_pair_t;
 
     std::vector<Image> process_image(const Image & img);
+    std::vector<Image> process_image(const Image & img,
+        const std::size_t memory_budget, ProcessReport & report,
+        const std::size_t num_values = SIZE_MAX,
+        const TieBreak tie_break = TieBreak::SMALLEST_NONZERO);
+    std::vector<Image> process_image(const MortonImage & img);
+    std::size_t plan_levels(const Image & img, const std::size_t num_levels,
+        const std::size_t memory_budget, const std::size_t num_values,
+        ProcessReport & report);
     void write_to_file(const Image & img, const std::string & filename);
     Image generate_randomized_image(const std::size_t dims);
+    Image generate_randomized_image(const std::size_t dims,
+        const std::uint64_t seed,
+        const FillOptions & options = FillOptions());
     void fill_image(Image & img);
+    void fill_image(Image & img, const std::uint64_t seed,
+        const FillOptions & options = FillOptions());
+    std::vector<std::vector<std::size_t>> find_level_shapes(
+        const std::vector<std::size_t> & shape);
     std::size_t find_max_l(const Image & img);
-    image_pair_t downsample_image(const Image & img);
-    image_pair_t downsample_reduce(const image_pair_t & img_pair);
+    image_pair_t downsample_image(const Image & img, const std::size_t l = 1,
+        const bool keep_modes = true,
+        const TieBreak tie_break = TieBreak::FIRST_REACHED);
+    image_pair_t downsample_reduce(const image_pair_t & img_pair,
+        const TieBreak tie_break = TieBreak::FIRST_REACHED);
+    std::vector<MortonImage> downsample_morton(const MortonImage & img,
+        ThreadPool & tp);
+    void downsample_morton(const MortonImage & img,
+        std::vector<MortonImage> & levels, ThreadPool & tp);
+    mode_map_t count_morton_block(const MortonImage & img,
+        std::vector<MortonImage> & levels, const std::size_t l,
+        const std::size_t j);
+    void add_to_mode(mode_map_t & mode_map, image_data_t & mode,
+        const image_data_t key, const std::size_t count,
+        const TieBreak tie_break);
     Image create_reduced_image(const Image & img, const std::size_t dim_size);
-    mode_pair_t find_mode(const Image & img, const std::size_t start_index);
+    mode_pair_t find_mode(const Image & img, const std::size_t start_index,
+        const std::size_t window_size = 2, const bool count_zeros = true,
+        const TieBreak tie_break = TieBreak::FIRST_REACHED);
     mode_pair_t reduce_modes(const Image & img,
         const mode_array_t & mode_array,
-        const std::size_t start_index);
+        const std::size_t start_index,
+        const TieBreak tie_break = TieBreak::FIRST_REACHED);
 }
 #endif
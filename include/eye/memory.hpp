@@ -0,0 +1,68 @@
+#ifndef EYE_MEMORY_HPP
+#define EYE_MEMORY_HPP
+
+#include <cstdint>
+#include <eye/common.hpp>
+#include <eye/constants.hpp>
+#include <eye/image.hpp>
+
+namespace eye {
+    /**
+     * Summary of the memory used while processing an image.
+     */
+    struct ProcessReport {
+        std::size_t memory_budget = SIZE_MAX;
+        // Peak predicted by the planner before processing started. Zero if
+        // no planning was needed.
+        std::size_t planned_peak_bytes = 0;
+        // Peak estimated while processing from the sizes of the images,
+        // histograms and tasks actually held. This is an accounting of the
+        // data structures, not a measurement of the process.
+        std::size_t estimated_peak_bytes = 0;
+        // Levels counted directly from the base image rather than reduced.
+        std::size_t recomputed_levels = 0;
+        bool within_budget = true;
+    };
+
+    // Approximate heap footprint of a single entry in a mode map, counting
+    // the red-black tree node links alongside the key-value pair, plus the
+    // allocator's chunk header and rounding to 16 bytes.
+    const std::size_t MODE_NODE_BYTES = (sizeof(mode_map_t::value_type) +
+        5 * sizeof(void *) + 15) / 16 * 16;
+
+    // Approximate footprint of a queued task: its future, shared state,
+    // packaged task and queue entry.
+    const std::size_t TASK_BYTES = 256;
+
+    inline std::size_t image_bytes(const std::size_t num_dims,
+            const std::size_t num_elements) {
+        return sizeof(Image) + num_dims * sizeof(std::size_t) +
+            num_elements * sizeof(image_data_t);
+    }
+
+    inline std::size_t image_bytes(const Image & img) {
+        return image_bytes(img.num_dims, img.img_array.size());
+    }
+
+    inline std::size_t mode_map_bytes(const std::size_t num_entries) {
+        return sizeof(mode_map_t) + num_entries * MODE_NODE_BYTES;
+    }
+
+    /**
+     * Approximate footprint of the tasks needed to compute num_elements
+     * output elements.
+     */
+    inline std::size_t task_bytes(const std::size_t num_elements) {
+        return (num_elements / DOWNSAMPLE_BLOCK_SIZE + 1) * TASK_BYTES;
+    }
+
+    inline std::size_t mode_array_bytes(const mode_array_t & mode_array) {
+        std::size_t bytes = 0;
+        for (const auto & mode_map : mode_array) {
+            bytes += mode_map_bytes(mode_map.size());
+        }
+
+        return bytes;
+    }
+}
+#endif
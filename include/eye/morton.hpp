@@ -0,0 +1,176 @@
+#ifndef EYE_MORTON_HPP
+#define EYE_MORTON_HPP
+
+#include <vector>
+#include <eye/common.hpp>
+#include <eye/image.hpp>
+
+namespace eye {
+    /**
+     * Builds per-dimension lookup tables mapping a coordinate to its bits in
+     * a Morton (Z-order) index.
+     *
+     * Bits are interleaved from least to most significant, with the first
+     * dimension lowest. Dimensions shorter than others stop contributing
+     * bits once exhausted, so every aligned block of 2^k elements along each
+     * dimension occupies a contiguous range of Morton indices.
+     */
+    inline std::vector<std::vector<std::size_t>> morton_tables(
+            const std::vector<std::size_t> & shape) {
+        std::size_t num_dims = shape.size();
+        std::vector<std::vector<std::size_t>> tables(num_dims);
+        for (std::size_t i = 0; i < num_dims; i++) {
+            tables[i].assign(shape[i], 0);
+        }
+
+        std::size_t bit = 0;
+        for (std::size_t b = 0; ; b++) {
+            bool exhausted = true;
+            for (std::size_t i = 0; i < num_dims; i++) {
+                if (shape[i] <= (std::size_t(1) << b)) {
+                    continue;
+                }
+                exhausted = false;
+
+                for (std::size_t c = 0; c < shape[i]; c++) {
+                    if ((c >> b) & 1) {
+                        tables[i][c] |= std::size_t(1) << bit;
+                    }
+                }
+                bit++;
+            }
+
+            if (exhausted) {
+                return tables;
+            }
+        }
+    }
+
+    /**
+     * Visits every element of an array in row-major order (first dimension
+     * fastest), passing both its row-major and its Morton index.
+     */
+    template<typename F>
+    inline void morton_loop(const std::vector<std::size_t> & shape, F f) {
+        std::size_t num_dims = shape.size();
+        std::vector<std::vector<std::size_t>> tables = morton_tables(shape);
+        std::vector<std::size_t> positions(num_dims, 0);
+
+        std::size_t num_elements = 1;
+        for (std::size_t i = 0; i < num_dims; i++) {
+            num_elements *= shape[i];
+        }
+
+        // Morton bits contributed by every dimension but the first.
+        std::size_t row_bits = 0;
+        std::size_t index = 0;
+        while (index < num_elements) {
+            for (std::size_t p = 0; p < shape[0]; p++) {
+                f(index, row_bits | tables[0][p]);
+                index++;
+            }
+
+            // Carry into the higher dimensions.
+            for (std::size_t i = 1; i < num_dims; i++) {
+                if (++positions[i] < shape[i]) {
+                    break;
+                }
+                positions[i] = 0;
+            }
+
+            row_bits = 0;
+            for (std::size_t i = 1; i < num_dims; i++) {
+                row_bits |= tables[i][positions[i]];
+            }
+        }
+    }
+
+    /**
+     * Image stored in Morton order.
+     *
+     * Every aligned 2^k window of the image is a contiguous range of data,
+     * and element j of a downsampled level covers a contiguous range of the
+     * level below it.
+     */
+    class MortonImage {
+        public:
+
+        std::vector<image_data_t> data;
+        std::size_t num_dims;
+        std::vector<std::size_t> shape;
+
+        MortonImage();
+        explicit MortonImage(const Image & img);
+        MortonImage(const image_data_t * row_major_data,
+            const std::vector<std::size_t> & shape);
+
+        void reshape(const std::vector<std::size_t> & shape);
+        void assign(const image_data_t * row_major_data,
+            const std::vector<std::size_t> & shape);
+        void write_row_major(image_data_t * row_major_data) const;
+        Image to_image() const;
+    };
+
+    inline MortonImage::MortonImage() : num_dims(0) {}
+
+    inline MortonImage::MortonImage(const Image & img) {
+        this->reshape(img.shape);
+        morton_loop(this->shape, [&](const std::size_t index,
+                const std::size_t morton_index) {
+            this->data[morton_index] = img.img_array(index);
+        });
+    }
+
+    inline MortonImage::MortonImage(const image_data_t * row_major_data,
+            const std::vector<std::size_t> & shape) {
+        this->assign(row_major_data, shape);
+    }
+
+    /**
+     * Resizes the image, reusing the existing allocation where possible.
+     */
+    inline void MortonImage::reshape(const std::vector<std::size_t> & shape) {
+        this->shape = shape;
+        this->num_dims = shape.size();
+
+        std::size_t num_elements = 1;
+        for (std::size_t i = 0; i < this->num_dims; i++) {
+            num_elements *= shape[i];
+        }
+        this->data.resize(num_elements);
+    }
+
+    /**
+     * Converts row-major data (first dimension fastest) into Morton order.
+     */
+    inline void MortonImage::assign(const image_data_t * row_major_data,
+            const std::vector<std::size_t> & shape) {
+        this->reshape(shape);
+        morton_loop(this->shape, [&](const std::size_t index,
+                const std::size_t morton_index) {
+            this->data[morton_index] = row_major_data[index];
+        });
+    }
+
+    /**
+     * Converts back into row-major data (first dimension fastest).
+     */
+    inline void MortonImage::write_row_major(
+            image_data_t * row_major_data) const {
+        morton_loop(this->shape, [&](const std::size_t index,
+                const std::size_t morton_index) {
+            row_major_data[index] = this->data[morton_index];
+        });
+    }
+
+    inline Image MortonImage::to_image() const {
+        Image img(image_array_t(this->shape.begin(), this->shape.end()));
+        morton_loop(this->shape, [&](const std::size_t index,
+                const std::size_t morton_index) {
+            img.img_array(index) = this->data[morton_index];
+        });
+
+        return img;
+    }
+}
+#endif
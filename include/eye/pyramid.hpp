@@ -0,0 +1,131 @@
+#ifndef EYE_PYRAMID_HPP
+#define EYE_PYRAMID_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <eye/common.hpp>
+#include <eye/image.hpp>
+
+namespace eye {
+    /**
+     * Pyramid container file layout (all integers in native byte order):
+     *
+     *   header  64 bytes: magic, version, number of levels, chunk edge,
+     *           index offset and index size
+     *   chunks  chunk data in the order they were written
+     *   index   for each level: number of dimensions, shape, then one
+     *           ChunkEntry per chunk
+     *
+     * Every level is split into chunks of chunk_edge elements along each
+     * dimension (or the whole dimension, if shorter), so every dimension must
+     * be a multiple of chunk_edge or shorter than it. Chunks are numbered
+     * and their elements laid out with the first dimension fastest.
+     */
+    const char PYRAMID_MAGIC[8] = { 'E', 'Y', 'E', 'P', 'Y', 'R', 'M', 'D' };
+    const std::uint32_t PYRAMID_VERSION = 1;
+    const std::size_t PYRAMID_HEADER_BYTES = 64;
+
+    enum class ChunkEncoding : std::uint32_t {
+        RAW = 0,
+        // Run-length encoded as (run length, value) pairs.
+        RLE = 1
+    };
+
+    struct PyramidOptions {
+        // Must be a power of 2, and chunks must not exceed 4GiB on any level.
+        std::size_t chunk_edge = 256;
+        // Run-length encode chunks where that makes them smaller.
+        bool compress = true;
+    };
+
+    struct ChunkEntry {
+        std::uint64_t offset;
+        std::uint32_t stored_bytes;
+        std::uint32_t encoding;
+    };
+
+    /**
+     * Chunk geometry and index of a single level of a pyramid.
+     */
+    class PyramidLevel {
+        public:
+
+        std::vector<std::size_t> shape;
+        std::vector<std::size_t> chunk_shape;
+        // Number of chunks along each dimension.
+        std::vector<std::size_t> grid_shape;
+        std::size_t chunk_elements;
+        std::vector<ChunkEntry> chunks;
+
+        PyramidLevel(const std::vector<std::size_t> & shape,
+            const std::size_t chunk_edge);
+
+        std::size_t chunk_index(const std::vector<std::size_t> & tile) const;
+        void copy_chunk(const Image & img, const std::size_t chunk,
+            image_data_t * chunk_data) const;
+        void paste_chunk(Image & img, const std::size_t chunk,
+            const image_data_t * chunk_data) const;
+    };
+
+    /**
+     * Writes a pyramid container file.
+     *
+     * Levels must all be added before any chunk is written. Chunks may then
+     * be written concurrently from any number of threads, in any order.
+     */
+    class PyramidWriter {
+        public:
+
+        PyramidWriter(const std::string & filename,
+            const PyramidOptions & options = PyramidOptions());
+        ~PyramidWriter();
+
+        std::size_t add_level(const std::vector<std::size_t> & shape);
+        const PyramidLevel & level(const std::size_t l) const;
+        void write_chunk(const std::size_t l, const std::size_t chunk,
+            const image_data_t * chunk_data);
+        void close();
+
+        private:
+
+        int fd;
+        PyramidOptions options;
+        std::vector<PyramidLevel> levels;
+        std::atomic<std::uint64_t> end_offset;
+    };
+
+    /**
+     * Reads individual chunks of a pyramid container file.
+     *
+     * Only the index is loaded on opening; each chunk is then fetched with a
+     * single positioned read, which is safe to do from multiple threads.
+     */
+    class PyramidReader {
+        public:
+
+        PyramidReader(const std::string & filename);
+        PyramidReader(const PyramidReader &) = delete;
+        PyramidReader & operator=(const PyramidReader &) = delete;
+        ~PyramidReader();
+
+        std::size_t num_levels() const;
+        const PyramidLevel & level(const std::size_t l) const;
+        void read_chunk(const std::size_t l, const std::size_t chunk,
+            image_data_t * chunk_data) const;
+        Image read_tile(const std::size_t l,
+            const std::vector<std::size_t> & tile) const;
+        Image read_level(const std::size_t l) const;
+
+        private:
+
+        int fd;
+        std::vector<PyramidLevel> levels;
+    };
+
+    void write_pyramid(const std::vector<Image> & levels,
+        const std::string & filename,
+        const PyramidOptions & options = PyramidOptions());
+}
+#endif
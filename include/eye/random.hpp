@@ -0,0 +1,64 @@
+#ifndef EYE_RANDOM_HPP
+#define EYE_RANDOM_HPP
+
+#include <cstdint>
+#include <eye/common.hpp>
+
+namespace eye {
+    /**
+     * Spatial structure of the values written by the synthetic image
+     * generator.
+     */
+    enum class Distribution {
+        // Independent uniform values for every element.
+        UNIFORM,
+        // Hyperspherical blobs of constant value over a zero background.
+        BLOBS,
+        // Regions of constant value around randomly placed sites.
+        VORONOI
+    };
+
+    /**
+     * Parameters for synthetic image generation.
+     */
+    struct FillOptions {
+        Distribution distribution = Distribution::UNIFORM;
+        // Values are drawn from [0, max_value].
+        image_data_t max_value = 4;
+        // Number of blobs or Voronoi sites for the structured distributions.
+        std::size_t num_features = 16;
+        // Fraction of elements replaced by uniform noise, in [0, 1].
+        double noise_level = 0.0;
+    };
+
+    /**
+     * Counter-based random number generator (SplitMix64 finalizer).
+     *
+     * Every output is a pure function of the seed and the counter, so any
+     * element can be generated independently of every other element.
+     */
+    inline std::uint64_t random_at(const std::uint64_t seed,
+            const std::uint64_t counter) {
+        std::uint64_t z = seed + (counter + 1) * 0x9E3779B97F4A7C15ULL;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+    /**
+     * Maps a random 64-bit value onto [0, 1).
+     */
+    inline double random_unit(const std::uint64_t r) {
+        return (r >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    /**
+     * Maps a random 64-bit value onto [0, bound].
+     */
+    inline image_data_t random_value(const std::uint64_t r,
+            const image_data_t bound) {
+        return static_cast<image_data_t>(
+            r % (static_cast<std::uint64_t>(bound) + 1));
+    }
+}
+#endif
@@ -0,0 +1,207 @@
+#ifndef EYE_SERVICE_HPP
+#define EYE_SERVICE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <eye/common.hpp>
+#include <eye/constants.hpp>
+#include <eye/morton.hpp>
+#include <eye/thread_pool.hpp>
+
+namespace eye {
+    /**
+     * Protocol of the local downsampling service.
+     *
+     * A client writes its image in row-major order (first dimension fastest)
+     * to a POSIX shared memory segment, connects to the service's Unix domain
+     * socket and sends a single ServiceRequest. The service reads the image
+     * straight from the segment and answers with a single ServiceResponse
+     * naming a new segment that holds every downsampled level back to back,
+     * in row-major order with shapes given by find_level_shapes(). Output
+     * segments are pooled by the service: once done reading, the client
+     * hands the segment back with a RELEASE request carrying the segment's
+     * name and the lease token from the response, and must not touch it
+     * afterwards. Only the current lease can release a segment, so a stale
+     * or guessed release is refused. Segments that are never released stay
+     * leased until the service exits.
+     */
+    const std::size_t SERVICE_MAX_DIMS = 8;
+    const std::size_t SERVICE_NAME_BYTES = 64;
+    const std::size_t SERVICE_MESSAGE_BYTES = 128;
+    // Number of released output segments kept mapped for reuse.
+    const std::size_t SERVICE_MAX_FREE_SEGMENTS = 16;
+    // Time a client has to send its whole request, in microseconds.
+    const std::uint64_t SERVICE_REQUEST_TIMEOUT_US = 1000000;
+    // Number of most recent jobs the latency statistics cover.
+    const std::size_t SERVICE_LATENCY_WINDOW = 1024;
+
+    enum class RequestType : std::uint32_t {
+        PROCESS = 0,
+        STATS = 1,
+        // Returns the output segment named in the request to the pool.
+        RELEASE = 2
+    };
+
+    enum class ServiceStatus : std::uint32_t {
+        OK = 0,
+        // The job queue is full; the client may retry later.
+        BUSY = 1,
+        ERROR = 2
+    };
+
+    struct ServiceRequest {
+        std::uint32_t type;
+        std::uint32_t num_dims;
+        std::uint64_t shape[SERVICE_MAX_DIMS];
+        // Lease token of the segment to release.
+        std::uint64_t lease;
+        char shm_name[SERVICE_NAME_BYTES];
+    };
+
+    struct ServiceResponse {
+        std::uint32_t status;
+        std::uint32_t num_levels;
+        std::uint64_t output_bytes;
+        // Time spent waiting in the queue and processing, in microseconds.
+        std::uint64_t queue_us;
+        std::uint64_t process_us;
+        // Token that releases the output segment.
+        std::uint64_t lease;
+        char shm_name[SERVICE_NAME_BYTES];
+        char message[SERVICE_MESSAGE_BYTES];
+    };
+
+    struct ServiceStats {
+        std::uint64_t completed;
+        std::uint64_t rejected;
+        std::uint64_t failed;
+        std::uint64_t running;
+        std::uint64_t queued;
+        // End-to-end job latencies over the recent window, in microseconds.
+        std::uint64_t latency_mean_us;
+        std::uint64_t latency_p50_us;
+        std::uint64_t latency_p99_us;
+        std::uint64_t latency_max_us;
+    };
+
+    struct ServiceOptions {
+        std::string socket_path = "/tmp/eye.sock";
+        // Number of jobs processed at once.
+        std::size_t max_running_jobs = 2;
+        // Number of jobs allowed to wait before new ones are turned away.
+        std::size_t max_queued_jobs = 64;
+        std::size_t work_threads = MAX_WORK_THREADS;
+    };
+
+    /**
+     * Mapping of a POSIX shared memory segment.
+     *
+     * A created segment is mapped for writing; an opened one for reading.
+     */
+    class SharedMemory {
+        public:
+
+        std::string name;
+        std::size_t bytes;
+        void * data;
+
+        SharedMemory(const std::string & name, const std::size_t bytes,
+            const bool create);
+        SharedMemory(const SharedMemory &) = delete;
+        SharedMemory & operator=(const SharedMemory &) = delete;
+        ~SharedMemory();
+
+        void unlink();
+    };
+
+    /**
+     * Long-running downsampling service.
+     *
+     * A warm pool of worker threads runs the Morton kernels for every job.
+     * The buffers holding each job's Morton image and levels, and the
+     * shared memory segments its output is returned in, are recycled
+     * between jobs, so a warm service neither allocates nor faults in fresh
+     * pages for a job of a size it has seen before.
+     */
+    class Service {
+        public:
+
+        Service(const ServiceOptions & options = ServiceOptions());
+        ~Service();
+
+        void run();
+        void stop();
+        ServiceStats stats();
+
+        private:
+
+        struct Buffers {
+            MortonImage img;
+            std::vector<MortonImage> levels;
+        };
+
+        struct Lease {
+            std::uint64_t token;
+            std::unique_ptr<SharedMemory> segment;
+        };
+
+        // Connection whose request has not fully arrived yet.
+        struct PendingRequest {
+            int fd;
+            std::uint64_t accepted_us;
+            std::size_t received;
+            ServiceRequest request;
+        };
+
+        ServiceOptions options;
+        int listen_fd;
+        std::atomic<bool> running;
+        std::atomic<std::uint64_t> job_counter;
+
+        std::mutex buffers_mutex;
+        std::vector<std::unique_ptr<Buffers>> free_buffers;
+
+        std::mutex segments_mutex;
+        std::multimap<std::size_t, std::unique_ptr<SharedMemory>>
+            free_segments;
+        std::map<std::string, Lease> leased_segments;
+
+        std::mutex stats_mutex;
+        std::size_t num_running;
+        std::size_t num_queued;
+        std::uint64_t num_completed;
+        std::uint64_t num_rejected;
+        std::uint64_t num_failed;
+        std::deque<std::uint64_t> latencies;
+
+        // Declared last so that their workers stop before anything they use
+        // is destroyed, with jobs stopping before the engine they feed.
+        ThreadPool engine;
+        ThreadPool jobs;
+
+        void dispatch_request(const int fd, ServiceRequest request,
+            const std::uint64_t accepted_us);
+        void handle_job(const int fd, const ServiceRequest request,
+            const std::uint64_t accepted_us);
+        ServiceResponse process(const ServiceRequest & request);
+        std::unique_ptr<Buffers> acquire_buffers();
+        void release_buffers(std::unique_ptr<Buffers> buffers);
+        SharedMemory & lease_segment(const std::size_t bytes,
+            std::uint64_t & token);
+        bool release_segment(const std::string & name,
+            const std::uint64_t token);
+    };
+
+    ServiceResponse submit_job(const std::string & socket_path,
+        const std::string & shm_name, const std::vector<std::size_t> & shape);
+    ServiceResponse release_output(const std::string & socket_path,
+        const ServiceResponse & output);
+    ServiceStats query_stats(const std::string & socket_path);
+}
+#endif
@@ -73,5 +73,44 @@ namespace eye {
 
         return index;
     }
+
+    /**
+     * Visits the windows numbered [begin, end) among the windows of
+     * window_size elements per dimension that tile data_shape, in the same
+     * order and with the same start indices as a polytopic_loop() with that
+     * stride. f is passed the window number and its start index.
+     */
+    template<typename F>
+    inline void window_loop(
+            const std::vector<std::size_t> & data_shape,
+            const std::size_t window_size,
+            F f,
+            const std::size_t begin,
+            const std::size_t end) {
+        std::size_t num_dims = data_shape.size();
+        std::vector<std::size_t> positions(num_dims);
+
+        // Find the position of the first window.
+        std::size_t remainder = begin;
+        for (std::size_t i = 0; i < num_dims; i++) {
+            std::size_t num_windows = (data_shape[i] + window_size - 1) /
+                window_size;
+            positions[i] = (remainder % num_windows) * window_size;
+            remainder /= num_windows;
+        }
+
+        for (std::size_t window = begin; window < end; window++) {
+            f(window, position_to_flat_index(data_shape, positions));
+
+            // Update position, carrying the one.
+            for (std::size_t i = 0; i < num_dims; i++) {
+                positions[i] += window_size;
+                if (positions[i] < data_shape[i]) {
+                    break;
+                }
+                positions[i] = 0;
+            }
+        }
+    }
 }
 #endif
@@ -0,0 +1,51 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <eye/common.hpp>
+#include <eye/functions.hpp>
+#include <eye/image.hpp>
+#include <eye/memory.hpp>
+
+using namespace std::chrono;
+
+int main(int argc, char * argv[]) {
+    // Memory budget in bytes, defaulting to 16 MiB.
+    std::size_t memory_budget = argc > 1 ? std::stoull(argv[1]) : 16 << 20;
+
+    // Determine shape of image to generate.
+    std::vector<int> shape_v = { 1024, 1024 };
+    std::size_t img_dims = shape_v.size();
+    int * shape = &shape_v[0];
+
+    // Generate a square image with reproducible values.
+    eye::image_array_t img_array(shape, shape + img_dims);
+    eye::Image img(img_array);
+    eye::fill_image(img, 42);
+
+    high_resolution_clock::time_point img_t1 = high_resolution_clock::now();
+
+    // Downsample images within the memory budget. The image holds values of
+    // at most 4, which bounds the size of its histograms.
+    eye::ProcessReport report;
+    std::vector<eye::Image> ds_images = eye::process_image(img,
+        memory_budget, report, 4);
+
+    high_resolution_clock::time_point img_t2 = high_resolution_clock::now();
+    auto duration = duration_cast<milliseconds>(img_t2 - img_t1).count();
+    std::cout << "ELAPSED TIME TO PROCESS IMAGE: " << duration << "ms" <<
+        std::endl;
+
+    std::cout << "MEMORY BUDGET: " << report.memory_budget << " bytes" <<
+        std::endl;
+    std::cout << "PLANNED PEAK: " << report.planned_peak_bytes <<
+        " bytes" << std::endl;
+    std::cout << "ESTIMATED PEAK: " << report.estimated_peak_bytes <<
+        " bytes" << std::endl;
+    std::cout << "LEVELS RECOMPUTED FROM BASE IMAGE: " <<
+        report.recomputed_levels << " of " << ds_images.size() << std::endl;
+    if (!report.within_budget) {
+        std::cout << "WARNING: memory budget exceeded" << std::endl;
+    }
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <eye/common.hpp>
+#include <eye/functions.hpp>
+#include <eye/image.hpp>
+#include <eye/pyramid.hpp>
+
+using namespace std::chrono;
+
+int main() {
+    // Determine shape of image to generate.
+    std::vector<int> shape_v = { 1024, 1024 };
+    std::size_t img_dims = shape_v.size();
+    int * shape = &shape_v[0];
+
+    // Generate a square image with reproducible, structured values.
+    eye::image_array_t img_array(shape, shape + img_dims);
+    eye::Image img(img_array);
+    eye::FillOptions fill_options;
+    fill_options.distribution = eye::Distribution::BLOBS;
+    eye::fill_image(img, 42, fill_options);
+
+    // Downsample images and store them alongside the original.
+    std::vector<eye::Image> levels = eye::process_image(eye::MortonImage(img));
+    levels.insert(levels.begin(), img);
+
+    std::string filename = "1024_ds_" + std::to_string(img_dims) +
+        "d_pyramid.eye";
+
+    high_resolution_clock::time_point write_t1 = high_resolution_clock::now();
+    eye::PyramidOptions options;
+    options.chunk_edge = 64;
+    eye::write_pyramid(levels, filename, options);
+    high_resolution_clock::time_point write_t2 = high_resolution_clock::now();
+    auto duration = duration_cast<milliseconds>(write_t2 - write_t1).count();
+    std::cout << "ELAPSED TIME TO WRITE PYRAMID: " << duration << "ms" <<
+        std::endl;
+
+    // Fetch a single tile from each level.
+    eye::PyramidReader reader(filename);
+    for (std::size_t l = 0; l < reader.num_levels(); l++) {
+        const eye::PyramidLevel & level = reader.level(l);
+        std::vector<std::size_t> tile(level.grid_shape.size());
+        for (std::size_t i = 0; i < tile.size(); i++) {
+            tile[i] = level.grid_shape[i] / 2;
+        }
+
+        high_resolution_clock::time_point read_t1 =
+            high_resolution_clock::now();
+        eye::Image tile_img = reader.read_tile(l, tile);
+        high_resolution_clock::time_point read_t2 =
+            high_resolution_clock::now();
+        auto elapsed = duration_cast<microseconds>(read_t2 - read_t1).count();
+        std::cout << "LEVEL " << l << ": read tile of " <<
+            tile_img.img_array.size() << " values in " << elapsed << "us" <<
+            std::endl;
+    }
+
+    return 0;
+}
@@ -1,4 +1,5 @@
 #include <chrono>
+#include <cstdint>
 #include <iostream>
 #include <string>
 #include <eye/common.hpp>
@@ -8,13 +9,16 @@
 
 using namespace std::chrono;
 
-int main() {
+int main(int argc, char * argv[]) {
     const std::size_t IMAGE_DIMS = 2;
 
     high_resolution_clock::time_point start = high_resolution_clock::now();
 
-    // Generate an image with randomized dimensions and values.
-    eye::Image img(eye::generate_randomized_image(IMAGE_DIMS));
+    // Generate an image with randomized dimensions and values. Passing the
+    // seed reported by an earlier run reproduces its image.
+    eye::Image img(argc > 1 ?
+        eye::generate_randomized_image(IMAGE_DIMS, std::stoull(argv[1])) :
+        eye::generate_randomized_image(IMAGE_DIMS));
 
     // Create container to hold images.
     std::vector<eye::Image> ds_images;
@@ -0,0 +1,82 @@
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+#include <eye/common.hpp>
+#include <eye/functions.hpp>
+#include <eye/image.hpp>
+#include <eye/service.hpp>
+
+using namespace std::chrono;
+
+int main(int argc, char * argv[]) {
+    const std::size_t NUM_JOBS = 8;
+    std::string socket_path = argc > 1 ? argv[1] : "/tmp/eye.sock";
+
+    // Determine shape of image to generate.
+    std::vector<std::size_t> shape = { 1024, 1024 };
+
+    // Generate a square image with reproducible values.
+    eye::Image img(eye::image_array_t(shape.begin(), shape.end()));
+    eye::fill_image(img, 42);
+
+    // Hand the image to the service through shared memory.
+    std::string input_name = "/eye-demo-" + std::to_string(::getpid());
+    eye::SharedMemory input(input_name,
+        img.img_array.size() * sizeof(eye::image_data_t), true);
+    eye::image_data_t * input_data =
+        static_cast<eye::image_data_t *>(input.data);
+    for (std::size_t i = 0; i < img.img_array.size(); i++) {
+        input_data[i] = img.img_array(i);
+    }
+
+    // Compute the first level locally to check the service's results.
+    std::vector<eye::Image> ds_images = eye::process_image(img);
+    const eye::Image & expected = ds_images[0];
+
+    for (std::size_t job = 0; job < NUM_JOBS; job++) {
+        high_resolution_clock::time_point t1 = high_resolution_clock::now();
+        eye::ServiceResponse response = eye::submit_job(socket_path,
+            input_name, shape);
+        high_resolution_clock::time_point t2 = high_resolution_clock::now();
+
+        if (response.status !=
+                static_cast<std::uint32_t>(eye::ServiceStatus::OK)) {
+            std::cout << "JOB " << job << " FAILED: " << response.message <<
+                std::endl;
+            continue;
+        }
+
+        // Levels follow each other in the output, starting with the first.
+        std::size_t mismatches = 0;
+        {
+            eye::SharedMemory output(response.shm_name,
+                response.output_bytes, false);
+            const eye::image_data_t * output_data =
+                static_cast<const eye::image_data_t *>(output.data);
+
+            for (std::size_t i = 0; i < expected.img_array.size(); i++) {
+                mismatches += output_data[i] != expected.img_array(i);
+            }
+        }
+
+        // Hand the output segment back for the service to reuse.
+        eye::release_output(socket_path, response);
+
+        auto elapsed = duration_cast<microseconds>(t2 - t1).count();
+        std::cout << "JOB " << job << ": " << response.num_levels <<
+            " levels in " << elapsed << "us (queued " << response.queue_us <<
+            "us, processed " << response.process_us << "us), " <<
+            mismatches << " mismatches" << std::endl;
+    }
+
+    input.unlink();
+
+    eye::ServiceStats stats = eye::query_stats(socket_path);
+    std::cout << "SERVICE LATENCY: mean " << stats.latency_mean_us <<
+        "us, p50 " << stats.latency_p50_us << "us, p99 " <<
+        stats.latency_p99_us << "us, max " << stats.latency_max_us << "us" <<
+        std::endl;
+
+    return 0;
+}
@@ -1,5 +1,7 @@
 #include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
 #include <fstream>
 #include <functional>
@@ -13,6 +15,9 @@
 #include <eye/functions.hpp>
 #include <eye/image.hpp>
 #include <eye/math.hpp>
+#include <eye/memory.hpp>
+#include <eye/morton.hpp>
+#include <eye/random.hpp>
 #include <eye/thread_pool.hpp>
 #include <eye/utility.hpp>
 
@@ -21,18 +26,173 @@ namespace eye {
      * Takes an image and computes a series of downsampled images.
      */
     std::vector<Image> process_image(const Image & img) {
+        ProcessReport report;
+        return process_image(img, SIZE_MAX, report, SIZE_MAX,
+            TieBreak::FIRST_REACHED);
+    }
+
+    /**
+     * Takes an image and computes a series of downsampled images while
+     * keeping the retained image and histogram data within a memory budget
+     * where possible.
+     *
+     * Reducing the histograms of the previous level is cheap but keeps a
+     * histogram alive for every element of two levels at once. When that
+     * does not fit, the lowest levels are instead counted directly from the
+     * base image and their histograms discarded, trading compute for memory.
+     *
+     * num_values bounds the number of distinct non-zero values in the image
+     * (such as FillOptions::max_value) and tightens the plan if known. Ties
+     * must be broken independently of counting order for the result not to
+     * depend on the budget. Images of more than 2 dimensions are never
+     * recounted, as the flat indices of their windows are computed
+     * differently from those of the reduction.
+     */
+    std::vector<Image> process_image(const Image & img,
+            const std::size_t memory_budget, ProcessReport & report,
+            const std::size_t num_values, const TieBreak tie_break) {
         // Find the power of 2 of the smallest dimension of the image.
         std::size_t max_l = find_max_l(img);
+        std::size_t num_levels = std::max<std::size_t>(max_l, 2) - 1;
+
+        report = ProcessReport();
+        report.memory_budget = memory_budget;
+
+        std::size_t first_reduced_l = 1;
+        if (memory_budget != SIZE_MAX && img.num_dims <= 2) {
+            first_reduced_l = plan_levels(img, num_levels, memory_budget,
+                num_values, report);
+        }
 
-        // Initial count of modes.
         std::vector<Image> ds_images;
-        image_pair_t img_pair = downsample_image(img);
-        ds_images.push_back(img_pair.first);
+        std::size_t retained_bytes = image_bytes(img);
+        report.estimated_peak_bytes = retained_bytes;
+
+        // Count the levels that do not fit in memory from the base image.
+        // Each worker holds a single histogram at a time.
+        std::size_t l = 1;
+        for (; l < first_reduced_l; l++) {
+            ds_images.push_back(downsample_image(img, l, false,
+                tie_break).first);
+            const Image & ds_img = ds_images.back();
+            std::size_t num_entries = std::min(
+                img.img_array.size() / ds_img.img_array.size(), num_values);
+
+            retained_bytes += image_bytes(ds_img);
+            report.estimated_peak_bytes = std::max(
+                report.estimated_peak_bytes, retained_bytes +
+                task_bytes(ds_img.img_array.size()) +
+                MAX_WORK_THREADS * mode_map_bytes(num_entries));
+            report.recomputed_levels++;
+        }
 
-        // Reduce modes to produce each successive level of downsampling.
-        for (std::size_t l = 2; l < max_l; l++) {
-            img_pair = downsample_reduce(img_pair);
+        if (l <= num_levels) {
+            // Initial count of modes.
+            image_pair_t img_pair = downsample_image(img, l, true, tie_break);
             ds_images.push_back(img_pair.first);
+            retained_bytes += image_bytes(img_pair.first);
+            std::size_t modes_bytes = mode_array_bytes(img_pair.second);
+            report.estimated_peak_bytes = std::max(
+                report.estimated_peak_bytes, retained_bytes + modes_bytes +
+                task_bytes(img_pair.first.img_array.size()));
+
+            // Reduce modes to produce each successive level of downsampling.
+            for (l++; l <= num_levels; l++) {
+                image_pair_t next_pair = downsample_reduce(img_pair,
+                    tie_break);
+                ds_images.push_back(next_pair.first);
+                retained_bytes += image_bytes(next_pair.first);
+                std::size_t next_modes_bytes = mode_array_bytes(
+                    next_pair.second);
+                report.estimated_peak_bytes = std::max(
+                    report.estimated_peak_bytes, retained_bytes +
+                    modes_bytes + next_modes_bytes +
+                    task_bytes(next_pair.first.img_array.size()));
+
+                img_pair = std::move(next_pair);
+                modes_bytes = next_modes_bytes;
+            }
+        }
+
+        report.within_budget = report.estimated_peak_bytes <= memory_budget;
+
+        return ds_images;
+    }
+
+    /**
+     * Finds the lowest level from which histograms can be retained and
+     * reduced without the planned peak exceeding the memory budget.
+     *
+     * Returns num_levels + 1 if even the last level does not fit, in which
+     * case every level is counted directly from the base image.
+     */
+    std::size_t plan_levels(const Image & img, const std::size_t num_levels,
+            const std::size_t memory_budget, const std::size_t num_values,
+            ProcessReport & report) {
+        // The input and output images are held whatever the strategy.
+        std::size_t img_elements = img.img_array.size();
+        std::size_t fixed_bytes = image_bytes(img);
+        std::vector<std::size_t> modes_bytes(num_levels + 2, 0);
+        std::vector<std::size_t> recount_bytes(num_levels + 1, 0);
+        for (std::size_t l = 1; l <= num_levels; l++) {
+            std::size_t ds_elements = 1;
+            std::size_t ds_dims = 0;
+            for (std::size_t i = 0; i < img.num_dims; i++) {
+                std::size_t reduced_dim_size = img.shape[i] >> l;
+                if (reduced_dim_size > 1) {
+                    ds_elements *= reduced_dim_size;
+                    ds_dims++;
+                }
+            }
+
+            // A histogram holds at most one entry per element of its window.
+            std::size_t num_entries = std::min(img_elements / ds_elements,
+                num_values);
+
+            fixed_bytes += image_bytes(std::max<std::size_t>(ds_dims, 1),
+                ds_elements);
+            modes_bytes[l] = ds_elements * mode_map_bytes(num_entries) +
+                task_bytes(ds_elements);
+            recount_bytes[l] = MAX_WORK_THREADS * mode_map_bytes(num_entries) +
+                task_bytes(ds_elements);
+        }
+
+        // Two consecutive levels of histograms are alive during a reduction,
+        // so extend the reduced levels downwards while their peak fits.
+        std::size_t reduced_bytes = 0;
+        std::size_t first_reduced_l = num_levels + 1;
+        for (std::size_t l = num_levels; l >= 1; l--) {
+            std::size_t level_bytes = std::max(reduced_bytes,
+                modes_bytes[l] + modes_bytes[l + 1]);
+            if (fixed_bytes + level_bytes > memory_budget) {
+                break;
+            }
+            reduced_bytes = level_bytes;
+            first_reduced_l = l;
+        }
+
+        // Levels below are recounted, holding one histogram per worker.
+        for (std::size_t l = 1; l < first_reduced_l; l++) {
+            reduced_bytes = std::max(reduced_bytes, recount_bytes[l]);
+        }
+
+        report.planned_peak_bytes = fixed_bytes + reduced_bytes;
+
+        return first_reduced_l;
+    }
+
+    /**
+     * Takes an image in Morton order and computes a series of downsampled
+     * images, converting them to row-major order only on output.
+     */
+    std::vector<Image> process_image(const MortonImage & img) {
+        ThreadPool tp(MAX_WORK_THREADS);
+        std::vector<MortonImage> levels = downsample_morton(img, tp);
+        tp.stop();
+
+        std::vector<Image> ds_images;
+        for (const auto & level : levels) {
+            ds_images.push_back(level.to_image());
         }
 
         return ds_images;
@@ -75,9 +235,21 @@ namespace eye {
     }
 
     Image generate_randomized_image(const std::size_t dims) {
-        // Initialize random number generation.
-        long int seed = std::chrono::high_resolution_clock::now()
+        std::uint64_t seed = std::chrono::high_resolution_clock::now()
             .time_since_epoch().count();
+
+        // Report the seed so that the image can be reproduced.
+        std::cout << "Generated image seed: " << seed << std::endl;
+        return generate_randomized_image(dims, seed);
+    }
+
+    /**
+     * Generates an image with randomized dimensions and values that are
+     * fully determined by the given seed.
+     */
+    Image generate_randomized_image(const std::size_t dims,
+            const std::uint64_t seed, const FillOptions & options) {
+        // Initialize random number generation.
         std::minstd_rand generator(seed);
 
         // Generate random dimensionality for the image.
@@ -96,7 +268,7 @@ namespace eye {
 
         Image img(image_array_t(shape, shape + dims));
         delete [] shape;
-        fill_image(img);
+        fill_image(img, seed, options);
 
         return img;
     }
@@ -105,17 +277,181 @@ namespace eye {
      * Fills an image with random values.
      */
     void fill_image(Image & img) {
-        // Initialize random number generation.
-        long int seed = std::chrono::high_resolution_clock::now()
+        std::uint64_t seed = std::chrono::high_resolution_clock::now()
             .time_since_epoch().count();
-        std::minstd_rand generator(seed);
 
-        // Generates random values for each element of the image.
-        std::uniform_int_distribution<image_data_t> value_dist(0, 4);
+        // Report the seed so that the image can be reproduced.
+        std::cout << "Filled image with seed: " << seed << std::endl;
+        fill_image(img, seed);
+    }
+
+    /**
+     * Fills an image with random values in parallel.
+     *
+     * Each element is derived from the seed and its flat index alone, so the
+     * output is identical for any number of worker threads.
+     */
+    void fill_image(Image & img, const std::uint64_t seed,
+            const FillOptions & options) {
+        // Derive independent streams for each purpose from the seed.
+        const std::uint64_t value_seed = random_at(seed, 0);
+        const std::uint64_t noise_seed = random_at(seed, 1);
+        const std::uint64_t feature_seed = random_at(seed, 2);
+
+        // Place the features (blob centers or Voronoi sites) up front.
+        std::size_t min_dim = SIZE_MAX;
+        for (std::size_t i = 0; i < img.num_dims; i++) {
+            min_dim = std::min(min_dim, img.shape[i]);
+        }
+
+        std::size_t num_features = options.distribution ==
+            Distribution::UNIFORM ? 0 : std::max<std::size_t>(
+                options.num_features, 1);
+        std::vector<double> centers(num_features * img.num_dims);
+        std::vector<double> radii(num_features);
+        std::vector<image_data_t> values(num_features);
+        std::uint64_t counter = 0;
+        for (std::size_t k = 0; k < num_features; k++) {
+            for (std::size_t i = 0; i < img.num_dims; i++) {
+                centers[k * img.num_dims + i] = img.shape[i] *
+                    random_unit(random_at(feature_seed, counter++));
+            }
+            // Blob radii range from 1/16 to 1/4 of the smallest dimension.
+            double radius = min_dim * (0.0625 + 0.1875 *
+                random_unit(random_at(feature_seed, counter++)));
+            radii[k] = radius * radius;
+            // Blobs must stand out from the zero background.
+            image_data_t value = random_value(
+                random_at(feature_seed, counter++), options.max_value);
+            if (options.distribution == Distribution::BLOBS && value == 0) {
+                value = std::max<image_data_t>(options.max_value, 1);
+            }
+            values[k] = value;
+        }
+
+        // Generates the values for the flat index range [begin, end).
+        auto fill_block = [&](const std::size_t begin, const std::size_t end) {
+            // Recover the position of the first element of the block.
+            std::vector<std::size_t> positions(img.num_dims);
+            std::size_t remainder = begin;
+            for (std::size_t i = 0; i < img.num_dims; i++) {
+                positions[i] = remainder % img.shape[i];
+                remainder /= img.shape[i];
+            }
+
+            // Squared distances to each feature over every dimension but the
+            // first, which only change when a row is completed.
+            std::vector<double> row_distances(num_features);
+            bool new_row = true;
+
+            for (std::size_t index = begin; index < end; index++) {
+                image_data_t value = 0;
+
+                if (new_row) {
+                    for (std::size_t k = 0; k < num_features; k++) {
+                        double distance = 0.0;
+                        for (std::size_t i = 1; i < img.num_dims; i++) {
+                            double delta = positions[i] -
+                                centers[k * img.num_dims + i];
+                            distance += delta * delta;
+                        }
+                        row_distances[k] = distance;
+                    }
+                    new_row = false;
+                }
+
+                if (options.distribution == Distribution::UNIFORM) {
+                    value = random_value(random_at(value_seed, index),
+                        options.max_value);
+                } else {
+                    double nearest = HUGE_VAL;
+                    for (std::size_t k = 0; k < num_features; k++) {
+                        double delta = positions[0] -
+                            centers[k * img.num_dims];
+                        double distance = row_distances[k] + delta * delta;
+
+                        if (options.distribution == Distribution::BLOBS) {
+                            // Later blobs are painted over earlier ones.
+                            if (distance <= radii[k]) {
+                                value = values[k];
+                            }
+                        } else if (distance < nearest) {
+                            nearest = distance;
+                            value = values[k];
+                        }
+                    }
+                }
+
+                // Replace a fraction of the elements with uniform noise.
+                if (options.noise_level > 0.0 && random_unit(
+                        random_at(noise_seed, 2 * index)) <
+                        options.noise_level) {
+                    value = random_value(random_at(noise_seed, 2 * index + 1),
+                        options.max_value);
+                }
+
+                img.img_array(index) = value;
+
+                // Advance the position, carrying into higher dimensions.
+                for (std::size_t i = 0; i < img.num_dims; i++) {
+                    if (++positions[i] < img.shape[i]) {
+                        break;
+                    }
+                    positions[i] = 0;
+                    new_row = true;
+                }
+            }
+        };
+
+        // Block boundaries do not depend on the number of threads.
         std::size_t img_elements = img.img_array.size();
-        for (std::size_t i = 0; i < img_elements; i++) {
-            img.img_array(i) = value_dist(generator);
+        std::vector<std::future<void>> futures;
+
+        ThreadPool tp(MAX_WORK_THREADS);
+
+        for (std::size_t begin = 0; begin < img_elements;
+                begin += FILL_BLOCK_SIZE) {
+            std::size_t end = std::min(begin + FILL_BLOCK_SIZE, img_elements);
+            futures.push_back(tp.queue_task(fill_block, begin, end));
+        }
+
+        tp.stop();
+
+        for (auto & future : futures) {
+            future.get();
+        }
+    }
+
+    /**
+     * Calculates the shapes of the downsampled images that process_image()
+     * produces for an image of the given shape, reducing dimensions in the
+     * same way as create_reduced_image().
+     */
+    std::vector<std::vector<std::size_t>> find_level_shapes(
+            const std::vector<std::size_t> & shape) {
+        // Find the power of 2 of the smallest dimension of the image.
+        std::size_t max_l = SIZE_MAX;
+        for (std::size_t i = 0; i < shape.size(); i++) {
+            max_l = std::min(max_l, eye::log2(shape[i]));
         }
+        std::size_t num_levels = std::max<std::size_t>(max_l, 2) - 1;
+
+        std::vector<std::vector<std::size_t>> shapes;
+        for (std::size_t l = 1; l <= num_levels; l++) {
+            std::vector<std::size_t> reduced_dims;
+            for (std::size_t i = 0; i < shape.size(); i++) {
+                std::size_t reduced_dim_size = shape[i] >> l;
+                if (reduced_dim_size > 1) {
+                    reduced_dims.push_back(reduced_dim_size);
+                }
+            }
+            if (reduced_dims.empty()) {
+                reduced_dims.push_back(1);
+            }
+            shapes.push_back(reduced_dims);
+        }
+
+        return shapes;
     }
 
     /**
@@ -135,73 +471,243 @@ namespace eye {
     }
 
     /**
-     * Administrates mode calculations and returns the downsampled image.
+     * Administrates mode calculations and returns the image downsampled to
+     * level l, counting directly from the given image.
+     *
+     * Zeros are counted only at the first level; above it, the histograms
+     * they would be reduced from have already dropped them. If keep_modes is
+     * false, histograms are discarded as soon as their mode is known and the
+     * returned mode array is empty.
      */
-    image_pair_t downsample_image(const Image & img) {
-        std::size_t dim_size = 2;
+    image_pair_t downsample_image(const Image & img, const std::size_t l,
+            const bool keep_modes, const TieBreak tie_break) {
+        std::size_t dim_size = std::size_t(1) << l;
+        bool count_zeros = l == 1;
 
         Image ds_img = create_reduced_image(img, dim_size);
-        mode_array_t mode_array(ds_img.img_array.size());
+        std::size_t ds_elements = ds_img.img_array.size();
+        mode_array_t mode_array(keep_modes ? ds_elements : 0);
+
+        // Each task counts a block of windows and stores the results itself.
+        auto count_block = [&](const std::size_t begin, const std::size_t end) {
+            auto f = [&](const std::size_t ds_index, const std::size_t index) {
+                mode_pair_t result_pair = find_mode(img, index, dim_size,
+                    count_zeros, tie_break);
+                if (keep_modes) {
+                    mode_array[ds_index] = std::move(result_pair.first);
+                }
+                ds_img.img_array(ds_index) = result_pair.second;
+            };
+            window_loop(img.shape, dim_size, f, begin, end);
+        };
 
-        std::vector<std::future<mode_pair_t>> futures;
+        std::vector<std::future<void>> futures;
 
         ThreadPool tp(MAX_WORK_THREADS);
 
-        auto f = [&](const std::vector<std::size_t> & positions,
-            const std::size_t & index) {
-            futures.push_back(tp.queue_task(find_mode, std::ref(img),
-                index));
-        };
-        polytopic_loop(img.shape, f, 0, dim_size);
+        for (std::size_t begin = 0; begin < ds_elements;
+                begin += DOWNSAMPLE_BLOCK_SIZE) {
+            std::size_t end = std::min(begin + DOWNSAMPLE_BLOCK_SIZE,
+                ds_elements);
+            futures.push_back(tp.queue_task(count_block, begin, end));
+        }
 
         tp.stop();
 
-        std::size_t ds_index = 0;
         for (auto & future : futures) {
-            mode_pair_t result_pair = future.get();
-            mode_array[ds_index] = result_pair.first;
-            ds_img.img_array(ds_index) = result_pair.second;
-            ds_index++;
+            future.get();
         }
 
-        return std::make_pair(ds_img, mode_array);
+        return std::make_pair(std::move(ds_img), std::move(mode_array));
     }
 
     /**
      * Reduces the mode calculations from a previous downsampling to produce
      * the next level of downsampling.
      */
-    image_pair_t downsample_reduce(const image_pair_t & img_pair) {
+    image_pair_t downsample_reduce(const image_pair_t & img_pair,
+            const TieBreak tie_break) {
         std::size_t dim_size = 2;
 
         const Image & img = img_pair.first;
         const auto & prev_mode_array = img_pair.second;
 
         Image ds_img = create_reduced_image(img, dim_size);
-        mode_array_t mode_array(ds_img.img_array.size());
+        std::size_t ds_elements = ds_img.img_array.size();
+        mode_array_t mode_array(ds_elements);
+
+        // Each task reduces a block of windows and stores the results itself.
+        auto reduce_block = [&](const std::size_t begin,
+                const std::size_t end) {
+            auto f = [&](const std::size_t ds_index, const std::size_t index) {
+                mode_pair_t result_pair = reduce_modes(img, prev_mode_array,
+                    index, tie_break);
+                mode_array[ds_index] = std::move(result_pair.first);
+                ds_img.img_array(ds_index) = result_pair.second;
+            };
+            window_loop(img.shape, dim_size, f, begin, end);
+        };
 
-        std::vector<std::future<mode_pair_t>> futures;
+        std::vector<std::future<void>> futures;
 
         ThreadPool tp(MAX_WORK_THREADS);
 
-        auto f = [&](const std::vector<std::size_t> & positions,
-            const std::size_t index) {
-            futures.push_back(tp.queue_task(reduce_modes, std::ref(img),
-                std::ref(prev_mode_array), index));
-        };
-        polytopic_loop(img.shape, f, 0, dim_size);
+        for (std::size_t begin = 0; begin < ds_elements;
+                begin += DOWNSAMPLE_BLOCK_SIZE) {
+            std::size_t end = std::min(begin + DOWNSAMPLE_BLOCK_SIZE,
+                ds_elements);
+            futures.push_back(tp.queue_task(reduce_block, begin, end));
+        }
 
         tp.stop();
 
-        std::size_t ds_index = 0;
         for (auto & future : futures) {
-            mode_pair_t result_pair = future.get();
-            mode_array[ds_index] = result_pair.first;
-            ds_img.img_array(ds_index) = result_pair.second;
-            ds_index++;
+            future.get();
+        }
+
+        return std::make_pair(std::move(ds_img), std::move(mode_array));
+    }
+
+    std::vector<MortonImage> downsample_morton(const MortonImage & img,
+            ThreadPool & tp) {
+        std::vector<MortonImage> levels;
+        downsample_morton(img, levels, tp);
+
+        return levels;
+    }
+
+    /**
+     * Computes every level of downsampling of an image in Morton order,
+     * reusing the storage of the given levels where possible.
+     *
+     * The pyramid is split into independent subtrees that are each walked
+     * depth-first by a single task, so only the histograms along the current
+     * path are alive and every window read is a contiguous range. The few
+     * levels above the subtrees are reduced afterwards.
+     */
+    void downsample_morton(const MortonImage & img,
+            std::vector<MortonImage> & levels, ThreadPool & tp) {
+        std::vector<std::vector<std::size_t>> shapes = find_level_shapes(
+            img.shape);
+        std::size_t num_levels = shapes.size();
+
+        levels.resize(num_levels);
+        for (std::size_t l = 1; l <= num_levels; l++) {
+            levels[l - 1].reshape(shapes[l - 1]);
+        }
+
+        // Root the subtrees at the highest level that still has enough of
+        // them to keep every worker busy.
+        std::size_t root_l = 1;
+        while (root_l < num_levels &&
+                levels[root_l].data.size() >= MORTON_MIN_SUBTREES) {
+            root_l++;
+        }
+
+        std::size_t num_roots = levels[root_l - 1].data.size();
+        mode_array_t root_modes(num_roots);
+
+        auto walk = [&](const std::size_t begin, const std::size_t end) {
+            for (std::size_t j = begin; j < end; j++) {
+                root_modes[j] = count_morton_block(img, levels, root_l, j);
+            }
+        };
+
+        std::vector<std::future<void>> futures;
+        std::size_t roots_per_task = std::max<std::size_t>(
+            num_roots / MORTON_MIN_SUBTREES, 1);
+        for (std::size_t begin = 0; begin < num_roots;
+                begin += roots_per_task) {
+            std::size_t end = std::min(begin + roots_per_task, num_roots);
+            futures.push_back(tp.queue_task(walk, begin, end));
+        }
+
+        for (auto & future : futures) {
+            future.get();
+        }
+
+        // Reduce the remaining levels from the histograms of the roots.
+        mode_array_t prev_modes = std::move(root_modes);
+        for (std::size_t l = root_l + 1; l <= num_levels; l++) {
+            MortonImage & level = levels[l - 1];
+            mode_array_t mode_array(level.data.size());
+            std::size_t num_children = prev_modes.size() / mode_array.size();
+
+            for (std::size_t j = 0; j < mode_array.size(); j++) {
+                mode_map_t & mode_map = mode_array[j];
+                // Initialize so that the first item encountered will be set
+                // as mode.
+                mode_map.insert(std::make_pair(0, 0));
+                image_data_t mode = 0;
+
+                for (std::size_t c = j * num_children;
+                        c < (j + 1) * num_children; c++) {
+                    for (auto const & kv : prev_modes[c]) {
+                        add_to_mode(mode_map, mode, kv.first, kv.second,
+                            TieBreak::FIRST_REACHED);
+                    }
+                }
+
+                mode_map.erase(0);
+                level.data[j] = mode;
+            }
+
+            prev_modes = std::move(mode_array);
+        }
+    }
+
+    /**
+     * Computes the histogram of element j of level l of a Morton image by
+     * walking the contiguous block beneath it depth-first, and records its
+     * mode in the level.
+     */
+    mode_map_t count_morton_block(const MortonImage & img,
+            std::vector<MortonImage> & levels, const std::size_t l,
+            const std::size_t j) {
+        std::size_t below_size = l > 1 ?
+            levels[l - 2].data.size() : img.data.size();
+        std::size_t num_children = below_size / levels[l - 1].data.size();
+
+        mode_map_t mode_map;
+        // Initialize so that the first item encountered will be set as mode.
+        mode_map.insert(std::make_pair(0, 0));
+        image_data_t mode = 0;
+
+        for (std::size_t c = j * num_children; c < (j + 1) * num_children;
+                c++) {
+            if (l == 1) {
+                add_to_mode(mode_map, mode, img.data[c], 1,
+                    TieBreak::FIRST_REACHED);
+            } else {
+                for (auto const & kv : count_morton_block(img, levels,
+                        l - 1, c)) {
+                    add_to_mode(mode_map, mode, kv.first, kv.second,
+                        TieBreak::FIRST_REACHED);
+                }
+            }
         }
 
-        return std::make_pair(ds_img, mode_array);
+        mode_map.erase(0);
+        levels[l - 1].data[j] = mode;
+
+        return mode_map;
+    }
+
+    /**
+     * Adds a count for a value to a histogram and updates its mode.
+     */
+    void add_to_mode(mode_map_t & mode_map, image_data_t & mode,
+            const image_data_t key, const std::size_t count,
+            const TieBreak tie_break) {
+        std::size_t key_count = (mode_map[key] += count);
+        std::size_t mode_count = mode_map[mode];
+        if (key_count > mode_count) {
+            mode = key;
+        } else if (tie_break == TieBreak::SMALLEST_NONZERO &&
+                key_count == mode_count && key != 0 &&
+                (mode == 0 || key < mode)) {
+            mode = key;
+        }
     }
 
     /**
@@ -232,9 +738,15 @@ namespace eye {
 
     /**
      * Calculates the mode of a specific subsection of the given image.
+     *
+     * Zeros are left out of the returned histogram either way, but are only
+     * candidates for the mode if count_zeros is set.
      */
     mode_pair_t find_mode(const Image & img,
-            const std::size_t start_index) {
+            const std::size_t start_index,
+            const std::size_t window_size,
+            const bool count_zeros,
+            const TieBreak tie_break) {
         mode_map_t mode_map;
         // Initialize so that the first item encountered will be set as mode.
         mode_map.insert(std::make_pair(0, 0));
@@ -243,23 +755,17 @@ namespace eye {
         auto f = [&](const std::vector<std::size_t> & positions,
             const std::size_t & index) {
             image_data_t key = img.img_array(index);
-
-            // Keep a count of the values encountered to determine mode.
-            if (mode_map.count(key) > 0) {
-                mode_map[key]++;
-            } else {
-                // Encountered a new unique number, add it to the map.
-                mode_map.insert(std::make_pair(key, 1));
+            if (key == 0 && !count_zeros) {
+                return;
             }
 
-            // Update the mode as we count.
-            if (mode_map[key] > mode_map[mode]) {
-                mode = key;
-            }
+            // Keep a count of the values encountered and update the mode as
+            // we count.
+            add_to_mode(mode_map, mode, key, 1, tie_break);
         };
 
         // Loop through processing window and count.
-        std::vector<std::size_t> loop_shape(img.num_dims, 2);
+        std::vector<std::size_t> loop_shape(img.num_dims, window_size);
         polytopic_loop(img.shape, loop_shape, f, start_index);
 
         if (mode_map.count(0) > 0) {
@@ -271,7 +777,8 @@ namespace eye {
 
     mode_pair_t reduce_modes(const Image & img,
             const std::vector<mode_map_t> & mode_array,
-            const std::size_t start_index) {
+            const std::size_t start_index,
+            const TieBreak tie_break) {
         mode_map_t reduced_mode_map;
         // Initialize so that the first item encountered will be set as mode.
         reduced_mode_map.insert(std::make_pair(0, 0));
@@ -279,19 +786,11 @@ namespace eye {
 
         auto f = [&](const std::vector<std::size_t> & positions,
             const std::size_t & index) {
-            mode_map_t mode_map = mode_array[index];
+            const mode_map_t & mode_map = mode_array[index];
 
             for (auto const & kv : mode_map) {
-                // If key exists in both maps, add.
-                if (reduced_mode_map.count(kv.first) > 0) {
-                    reduced_mode_map[kv.first] += kv.second;
-                } else {
-                    reduced_mode_map.insert(std::make_pair(kv.first, kv.second));
-                }
-
-                if (reduced_mode_map[kv.first] > reduced_mode_map[mode]) {
-                    mode = kv.first;
-                }
+                add_to_mode(reduced_mode_map, mode, kv.first, kv.second,
+                    tie_break);
             }
         };
 
@@ -0,0 +1,520 @@
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <eye/common.hpp>
+#include <eye/constants.hpp>
+#include <eye/image.hpp>
+#include <eye/pyramid.hpp>
+#include <eye/thread_pool.hpp>
+
+namespace eye {
+    struct PyramidHeader {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t num_levels;
+        std::uint64_t chunk_edge;
+        std::uint64_t index_offset;
+        std::uint64_t index_size;
+        char reserved[24];
+    };
+
+    static_assert(sizeof(PyramidHeader) == PYRAMID_HEADER_BYTES,
+        "Pyramid header must match its on-disk size.");
+    static_assert(sizeof(ChunkEntry) == 16,
+        "Chunk entries must match their on-disk size.");
+
+    /**
+     * Writes the whole buffer at the given offset, retrying short writes.
+     */
+    void write_fully(const int fd, const void * buffer, const std::size_t size,
+            const std::uint64_t offset) {
+        const char * bytes = static_cast<const char *>(buffer);
+        std::size_t written = 0;
+        while (written < size) {
+            ssize_t result = ::pwrite(fd, bytes + written, size - written,
+                offset + written);
+            if (result < 0) {
+                throw std::runtime_error("Failed to write pyramid file.");
+            }
+            written += result;
+        }
+    }
+
+    /**
+     * Reads the whole buffer from the given offset, retrying short reads.
+     */
+    void read_fully(const int fd, void * buffer, const std::size_t size,
+            const std::uint64_t offset) {
+        char * bytes = static_cast<char *>(buffer);
+        std::size_t read = 0;
+        while (read < size) {
+            ssize_t result = ::pread(fd, bytes + read, size - read,
+                offset + read);
+            if (result <= 0) {
+                throw std::runtime_error("Failed to read pyramid file.");
+            }
+            read += result;
+        }
+    }
+
+    /**
+     * Visits each row (run along the first dimension) of a chunk, passing the
+     * flat index of the row's first element within the level and within the
+     * chunk.
+     */
+    template<typename F>
+    void chunk_row_loop(const PyramidLevel & level, const std::size_t chunk,
+            F f) {
+        std::size_t num_dims = level.shape.size();
+
+        std::vector<std::size_t> strides(num_dims);
+        std::size_t stride = 1;
+        for (std::size_t i = 0; i < num_dims; i++) {
+            strides[i] = stride;
+            stride *= level.shape[i];
+        }
+
+        // Find the flat index of the first element of the chunk.
+        std::size_t origin = 0;
+        std::size_t remainder = chunk;
+        for (std::size_t i = 0; i < num_dims; i++) {
+            origin += (remainder % level.grid_shape[i]) *
+                level.chunk_shape[i] * strides[i];
+            remainder /= level.grid_shape[i];
+        }
+
+        std::vector<std::size_t> positions(num_dims, 0);
+        for (std::size_t chunk_index = 0; chunk_index < level.chunk_elements;
+                chunk_index += level.chunk_shape[0]) {
+            std::size_t index = origin;
+            for (std::size_t i = 1; i < num_dims; i++) {
+                index += positions[i] * strides[i];
+            }
+
+            f(index, chunk_index);
+
+            // Carry into the higher dimensions.
+            for (std::size_t i = 1; i < num_dims; i++) {
+                if (++positions[i] < level.chunk_shape[i]) {
+                    break;
+                }
+                positions[i] = 0;
+            }
+        }
+    }
+
+    /**
+     * Run-length encodes the data as (run length, value) pairs. Returns an
+     * empty vector if the encoding would not be smaller than the data.
+     */
+    std::vector<image_data_t> rle_encode(const image_data_t * data,
+            const std::size_t num_elements) {
+        std::vector<image_data_t> encoded;
+        std::size_t i = 0;
+        while (i < num_elements) {
+            std::size_t run = 1;
+            while (i + run < num_elements && data[i + run] == data[i] &&
+                    run < UINT32_MAX) {
+                run++;
+            }
+
+            encoded.push_back(static_cast<image_data_t>(run));
+            encoded.push_back(data[i]);
+            if (encoded.size() >= num_elements) {
+                return std::vector<image_data_t>();
+            }
+
+            i += run;
+        }
+
+        return encoded;
+    }
+
+    void rle_decode(const std::vector<image_data_t> & encoded,
+            image_data_t * data, const std::size_t num_elements) {
+        std::size_t i = 0;
+        for (std::size_t k = 0; k + 1 < encoded.size(); k += 2) {
+            if (encoded[k] > num_elements - i) {
+                throw std::runtime_error("Corrupt chunk in pyramid file.");
+            }
+            std::fill(data + i, data + i + encoded[k], encoded[k + 1]);
+            i += encoded[k];
+        }
+
+        if (i != num_elements) {
+            throw std::runtime_error("Corrupt chunk in pyramid file.");
+        }
+    }
+
+    PyramidLevel::PyramidLevel(const std::vector<std::size_t> & shape,
+            const std::size_t chunk_edge) : shape(shape) {
+        if (chunk_edge == 0 || (chunk_edge & (chunk_edge - 1)) != 0) {
+            throw std::invalid_argument("Chunk edge must be a power of 2.");
+        }
+
+        std::size_t num_chunks = 1;
+        this->chunk_elements = 1;
+        for (std::size_t i = 0; i < shape.size(); i++) {
+            // Chunks must tile the level exactly, or elements would be lost.
+            if (shape[i] == 0 ||
+                    (shape[i] > chunk_edge && shape[i] % chunk_edge != 0)) {
+                throw std::invalid_argument("Every dimension must be a "
+                    "multiple of the chunk edge or shorter than it.");
+            }
+
+            std::size_t chunk_size = std::min(chunk_edge, shape[i]);
+            this->chunk_shape.push_back(chunk_size);
+            this->grid_shape.push_back(shape[i] / chunk_size);
+            this->chunk_elements *= chunk_size;
+            num_chunks *= shape[i] / chunk_size;
+        }
+
+        // Chunk sizes are stored in 32 bits.
+        if (this->chunk_elements > UINT32_MAX / sizeof(image_data_t)) {
+            throw std::invalid_argument("Chunks of this level would exceed "
+                "4GiB; use a smaller chunk edge.");
+        }
+
+        // A zero offset marks a chunk that has not been written.
+        this->chunks.assign(num_chunks, ChunkEntry{ 0, 0, 0 });
+    }
+
+    /**
+     * Converts chunk coordinates along each dimension into a chunk number.
+     */
+    std::size_t PyramidLevel::chunk_index(
+            const std::vector<std::size_t> & tile) const {
+        if (tile.size() != this->grid_shape.size()) {
+            throw std::out_of_range("Tile has the wrong number of dimensions.");
+        }
+
+        std::size_t chunk = 0;
+        std::size_t stride = 1;
+        for (std::size_t i = 0; i < tile.size(); i++) {
+            if (tile[i] >= this->grid_shape[i]) {
+                throw std::out_of_range("Tile lies outside of the level.");
+            }
+            chunk += tile[i] * stride;
+            stride *= this->grid_shape[i];
+        }
+
+        return chunk;
+    }
+
+    void PyramidLevel::copy_chunk(const Image & img, const std::size_t chunk,
+            image_data_t * chunk_data) const {
+        chunk_row_loop(*this, chunk, [&](const std::size_t index,
+                const std::size_t chunk_index) {
+            for (std::size_t p = 0; p < this->chunk_shape[0]; p++) {
+                chunk_data[chunk_index + p] = img.img_array(index + p);
+            }
+        });
+    }
+
+    void PyramidLevel::paste_chunk(Image & img, const std::size_t chunk,
+            const image_data_t * chunk_data) const {
+        chunk_row_loop(*this, chunk, [&](const std::size_t index,
+                const std::size_t chunk_index) {
+            for (std::size_t p = 0; p < this->chunk_shape[0]; p++) {
+                img.img_array(index + p) = chunk_data[chunk_index + p];
+            }
+        });
+    }
+
+    PyramidWriter::PyramidWriter(const std::string & filename,
+            const PyramidOptions & options) :
+            options(options), end_offset(PYRAMID_HEADER_BYTES) {
+        if (options.chunk_edge == 0 ||
+                (options.chunk_edge & (options.chunk_edge - 1)) != 0) {
+            throw std::invalid_argument("Chunk edge must be a power of 2.");
+        }
+        if (options.chunk_edge > UINT32_MAX / sizeof(image_data_t)) {
+            throw std::invalid_argument("Chunk edge is too large.");
+        }
+
+        this->fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC,
+            0644);
+        if (this->fd < 0) {
+            throw std::runtime_error("Cannot open " + filename +
+                " for writing.");
+        }
+    }
+
+    /**
+     * Closes the file without writing a header if close() was never called,
+     * leaving it unreadable rather than silently incomplete.
+     */
+    PyramidWriter::~PyramidWriter() {
+        if (this->fd >= 0) {
+            ::close(this->fd);
+        }
+    }
+
+    std::size_t PyramidWriter::add_level(
+            const std::vector<std::size_t> & shape) {
+        this->levels.emplace_back(shape, this->options.chunk_edge);
+
+        return this->levels.size() - 1;
+    }
+
+    const PyramidLevel & PyramidWriter::level(const std::size_t l) const {
+        return this->levels.at(l);
+    }
+
+    void PyramidWriter::write_chunk(const std::size_t l,
+            const std::size_t chunk, const image_data_t * chunk_data) {
+        PyramidLevel & level = this->levels.at(l);
+        if (chunk >= level.chunks.size()) {
+            throw std::out_of_range("Chunk lies outside of the level.");
+        }
+
+        std::vector<image_data_t> encoded;
+        if (this->options.compress) {
+            encoded = rle_encode(chunk_data, level.chunk_elements);
+        }
+
+        ChunkEntry entry;
+        const void * stored_data;
+        if (encoded.empty()) {
+            entry.encoding = static_cast<std::uint32_t>(ChunkEncoding::RAW);
+            entry.stored_bytes = level.chunk_elements * sizeof(image_data_t);
+            stored_data = chunk_data;
+        } else {
+            entry.encoding = static_cast<std::uint32_t>(ChunkEncoding::RLE);
+            entry.stored_bytes = encoded.size() * sizeof(image_data_t);
+            stored_data = encoded.data();
+        }
+
+        // Reserve space at the end of the file so writers never overlap.
+        entry.offset = this->end_offset.fetch_add(entry.stored_bytes);
+        write_fully(this->fd, stored_data, entry.stored_bytes, entry.offset);
+
+        level.chunks[chunk] = entry;
+    }
+
+    /**
+     * Writes the index and header once every chunk has been written.
+     */
+    void PyramidWriter::close() {
+        std::vector<char> index;
+        auto append = [&](const void * data, const std::size_t size) {
+            const char * bytes = static_cast<const char *>(data);
+            index.insert(index.end(), bytes, bytes + size);
+        };
+
+        for (const auto & level : this->levels) {
+            std::uint32_t num_dims = level.shape.size();
+            std::uint32_t padding = 0;
+            append(&num_dims, sizeof(num_dims));
+            append(&padding, sizeof(padding));
+            for (std::size_t i = 0; i < num_dims; i++) {
+                std::uint64_t dim_size = level.shape[i];
+                append(&dim_size, sizeof(dim_size));
+            }
+            append(level.chunks.data(),
+                level.chunks.size() * sizeof(ChunkEntry));
+        }
+
+        PyramidHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, PYRAMID_MAGIC, sizeof(header.magic));
+        header.version = PYRAMID_VERSION;
+        header.num_levels = this->levels.size();
+        header.chunk_edge = this->options.chunk_edge;
+        header.index_offset = this->end_offset;
+        header.index_size = index.size();
+
+        write_fully(this->fd, index.data(), index.size(), header.index_offset);
+        write_fully(this->fd, &header, sizeof(header), 0);
+
+        if (::close(this->fd) != 0) {
+            throw std::runtime_error("Failed to close pyramid file.");
+        }
+        this->fd = -1;
+    }
+
+    PyramidReader::PyramidReader(const std::string & filename) {
+        this->fd = ::open(filename.c_str(), O_RDONLY);
+        if (this->fd < 0) {
+            throw std::runtime_error("Cannot open " + filename +
+                " for reading.");
+        }
+
+        try {
+            PyramidHeader header;
+            read_fully(this->fd, &header, sizeof(header), 0);
+            if (std::memcmp(header.magic, PYRAMID_MAGIC,
+                    sizeof(header.magic)) != 0) {
+                throw std::runtime_error(filename +
+                    " is not a pyramid file.");
+            }
+            if (header.version != PYRAMID_VERSION) {
+                throw std::runtime_error(filename +
+                    " has an unsupported pyramid version.");
+            }
+            if (header.chunk_edge == 0 ||
+                    (header.chunk_edge & (header.chunk_edge - 1)) != 0) {
+                throw std::runtime_error("Corrupt index in " + filename +
+                    ".");
+            }
+
+            std::vector<char> index(header.index_size);
+            read_fully(this->fd, index.data(), index.size(),
+                header.index_offset);
+
+            std::size_t position = 0;
+            auto extract = [&](void * data, const std::size_t size) {
+                if (position + size > index.size()) {
+                    throw std::runtime_error("Corrupt index in " + filename +
+                        ".");
+                }
+                std::memcpy(data, index.data() + position, size);
+                position += size;
+            };
+
+            for (std::size_t l = 0; l < header.num_levels; l++) {
+                std::uint32_t num_dims;
+                std::uint32_t padding;
+                extract(&num_dims, sizeof(num_dims));
+                extract(&padding, sizeof(padding));
+
+                std::vector<std::size_t> shape(num_dims);
+                for (std::size_t i = 0; i < num_dims; i++) {
+                    std::uint64_t dim_size;
+                    extract(&dim_size, sizeof(dim_size));
+                    if (dim_size == 0 || (dim_size > header.chunk_edge &&
+                            dim_size % header.chunk_edge != 0)) {
+                        throw std::runtime_error("Corrupt index in " +
+                            filename + ".");
+                    }
+                    shape[i] = dim_size;
+                }
+
+                this->levels.emplace_back(shape, header.chunk_edge);
+                auto & chunks = this->levels.back().chunks;
+                extract(chunks.data(), chunks.size() * sizeof(ChunkEntry));
+            }
+        } catch (...) {
+            ::close(this->fd);
+            throw;
+        }
+    }
+
+    PyramidReader::~PyramidReader() {
+        ::close(this->fd);
+    }
+
+    std::size_t PyramidReader::num_levels() const {
+        return this->levels.size();
+    }
+
+    const PyramidLevel & PyramidReader::level(const std::size_t l) const {
+        return this->levels.at(l);
+    }
+
+    /**
+     * Reads a chunk into a buffer of level(l).chunk_elements values.
+     */
+    void PyramidReader::read_chunk(const std::size_t l,
+            const std::size_t chunk, image_data_t * chunk_data) const {
+        const PyramidLevel & level = this->levels.at(l);
+        const ChunkEntry & entry = level.chunks.at(chunk);
+        if (entry.offset == 0) {
+            throw std::runtime_error("Chunk was never written.");
+        }
+
+        if (entry.encoding == static_cast<std::uint32_t>(ChunkEncoding::RAW)) {
+            if (entry.stored_bytes !=
+                    level.chunk_elements * sizeof(image_data_t)) {
+                throw std::runtime_error("Corrupt chunk in pyramid file.");
+            }
+            read_fully(this->fd, chunk_data, entry.stored_bytes, entry.offset);
+        } else if (entry.encoding ==
+                static_cast<std::uint32_t>(ChunkEncoding::RLE)) {
+            std::vector<image_data_t> encoded(
+                entry.stored_bytes / sizeof(image_data_t));
+            read_fully(this->fd, encoded.data(), entry.stored_bytes,
+                entry.offset);
+            rle_decode(encoded, chunk_data, level.chunk_elements);
+        } else {
+            throw std::runtime_error("Unknown chunk encoding.");
+        }
+    }
+
+    /**
+     * Reads the chunk at the given chunk coordinates as an image.
+     */
+    Image PyramidReader::read_tile(const std::size_t l,
+            const std::vector<std::size_t> & tile) const {
+        const PyramidLevel & level = this->levels.at(l);
+
+        std::vector<image_data_t> chunk_data(level.chunk_elements);
+        this->read_chunk(l, level.chunk_index(tile), chunk_data.data());
+
+        Image img(image_array_t(level.chunk_shape.begin(),
+            level.chunk_shape.end()));
+        for (std::size_t i = 0; i < level.chunk_elements; i++) {
+            img.img_array(i) = chunk_data[i];
+        }
+
+        return img;
+    }
+
+    Image PyramidReader::read_level(const std::size_t l) const {
+        const PyramidLevel & level = this->levels.at(l);
+
+        Image img(image_array_t(level.shape.begin(), level.shape.end()));
+        std::vector<image_data_t> chunk_data(level.chunk_elements);
+        for (std::size_t chunk = 0; chunk < level.chunks.size(); chunk++) {
+            this->read_chunk(l, chunk, chunk_data.data());
+            level.paste_chunk(img, chunk, chunk_data.data());
+        }
+
+        return img;
+    }
+
+    /**
+     * Writes a series of images into a single pyramid file, encoding and
+     * writing chunks concurrently.
+     */
+    void write_pyramid(const std::vector<Image> & levels,
+            const std::string & filename, const PyramidOptions & options) {
+        PyramidWriter writer(filename, options);
+        for (const auto & img : levels) {
+            writer.add_level(img.shape);
+        }
+
+        auto write = [&](const std::size_t l, const std::size_t chunk) {
+            const PyramidLevel & level = writer.level(l);
+            std::vector<image_data_t> chunk_data(level.chunk_elements);
+            level.copy_chunk(levels[l], chunk, chunk_data.data());
+            writer.write_chunk(l, chunk, chunk_data.data());
+        };
+
+        std::vector<std::future<void>> futures;
+
+        ThreadPool tp(MAX_WORK_THREADS);
+
+        for (std::size_t l = 0; l < levels.size(); l++) {
+            std::size_t num_chunks = writer.level(l).chunks.size();
+            for (std::size_t chunk = 0; chunk < num_chunks; chunk++) {
+                futures.push_back(tp.queue_task(write, l, chunk));
+            }
+        }
+
+        tp.stop();
+
+        // Rethrow any failure from the writers.
+        for (auto & future : futures) {
+            future.get();
+        }
+
+        writer.close();
+        std::cout << "Wrote pyramid to " << filename << std::endl;
+    }
+}
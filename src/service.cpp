@@ -0,0 +1,626 @@
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <eye/common.hpp>
+#include <eye/functions.hpp>
+#include <eye/morton.hpp>
+#include <eye/service.hpp>
+#include <eye/thread_pool.hpp>
+
+namespace eye {
+    std::uint64_t service_clock_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void send_message(const int fd, const void * message,
+            const std::size_t size) {
+        const char * bytes = static_cast<const char *>(message);
+        std::size_t sent = 0;
+        while (sent < size) {
+            ssize_t result = ::send(fd, bytes + sent, size - sent,
+                MSG_NOSIGNAL);
+            if (result < 0) {
+                throw std::runtime_error("Failed to send service message.");
+            }
+            sent += result;
+        }
+    }
+
+    void receive_message(const int fd, void * message, const std::size_t size) {
+        char * bytes = static_cast<char *>(message);
+        std::size_t received = 0;
+        while (received < size) {
+            ssize_t result = ::recv(fd, bytes + received, size - received, 0);
+            if (result <= 0) {
+                throw std::runtime_error(
+                    "Failed to receive service message.");
+            }
+            received += result;
+        }
+    }
+
+    sockaddr_un service_address(const std::string & socket_path) {
+        sockaddr_un address;
+        std::memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (socket_path.size() >= sizeof(address.sun_path)) {
+            throw std::invalid_argument("Socket path " + socket_path +
+                " is too long.");
+        }
+        std::strcpy(address.sun_path, socket_path.c_str());
+
+        return address;
+    }
+
+    SharedMemory::SharedMemory(const std::string & name,
+            const std::size_t bytes, const bool create) :
+            name(name), bytes(bytes), data(nullptr) {
+        if (bytes == 0) {
+            throw std::invalid_argument("Shared memory must not be empty.");
+        }
+
+        int fd = ::shm_open(name.c_str(),
+            create ? O_CREAT | O_EXCL | O_RDWR : O_RDONLY, 0600);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot open shared memory " + name +
+                ".");
+        }
+
+        bool sized;
+        if (create) {
+            sized = ::ftruncate(fd, bytes) == 0;
+        } else {
+            struct stat info;
+            sized = ::fstat(fd, &info) == 0 &&
+                static_cast<std::size_t>(info.st_size) >= bytes;
+        }
+
+        if (sized) {
+            this->data = ::mmap(nullptr, bytes,
+                create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        }
+        ::close(fd);
+
+        if (!sized || this->data == MAP_FAILED) {
+            this->data = nullptr;
+            if (create) {
+                ::shm_unlink(name.c_str());
+            }
+            throw std::runtime_error("Cannot map shared memory " + name +
+                ".");
+        }
+    }
+
+    SharedMemory::~SharedMemory() {
+        if (this->data != nullptr) {
+            ::munmap(this->data, this->bytes);
+        }
+    }
+
+    void SharedMemory::unlink() {
+        ::shm_unlink(this->name.c_str());
+    }
+
+    Service::Service(const ServiceOptions & options) :
+            options(options),
+            listen_fd(-1),
+            running(false),
+            job_counter(0),
+            num_running(0),
+            num_queued(0),
+            num_completed(0),
+            num_rejected(0),
+            num_failed(0),
+            engine(std::max<std::size_t>(options.work_threads, 1)),
+            jobs(std::max<std::size_t>(options.max_running_jobs, 1)) {
+        sockaddr_un address = service_address(options.socket_path);
+
+        this->listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (this->listen_fd < 0) {
+            throw std::runtime_error("Cannot create service socket.");
+        }
+
+        // Remove a socket left behind by a previous instance.
+        ::unlink(options.socket_path.c_str());
+
+        if (::bind(this->listen_fd, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address)) != 0 ||
+                ::listen(this->listen_fd, SOMAXCONN) != 0) {
+            ::close(this->listen_fd);
+            throw std::runtime_error("Cannot listen on " +
+                options.socket_path + ".");
+        }
+    }
+
+    /**
+     * Stops accepting connections, completes the jobs already queued and
+     * removes every output segment.
+     */
+    Service::~Service() {
+        ::close(this->listen_fd);
+        ::unlink(this->options.socket_path.c_str());
+
+        this->jobs.stop();
+
+        for (auto & kv : this->free_segments) {
+            kv.second->unlink();
+        }
+        for (auto & kv : this->leased_segments) {
+            kv.second.segment->unlink();
+        }
+    }
+
+    /**
+     * Accepts requests until stop() is called.
+     *
+     * Requests are read on this thread without ever blocking on a single
+     * client: every connection still sending its request is polled along
+     * with the listening socket, and one that stalls is dropped once its
+     * time runs out. Statistics and releases are answered at once and full
+     * queues reported; jobs are handed to the job pool, which bounds how
+     * many run concurrently.
+     */
+    void Service::run() {
+        this->running = true;
+
+        std::vector<PendingRequest> pending;
+        std::vector<pollfd> poll_fds;
+        while (this->running) {
+            poll_fds.assign(1, pollfd{ this->listen_fd, POLLIN, 0 });
+            for (const auto & client : pending) {
+                poll_fds.push_back(pollfd{ client.fd, POLLIN, 0 });
+            }
+
+            // Wake up regularly to notice a call to stop() or a stalled
+            // client.
+            int ready = ::poll(poll_fds.data(), poll_fds.size(), 100);
+            std::uint64_t now_us = service_clock_us();
+
+            std::size_t kept = 0;
+            for (std::size_t c = 0; c < pending.size(); c++) {
+                PendingRequest & client = pending[c];
+                bool closed = false;
+                if (ready > 0 && poll_fds[c + 1].revents != 0) {
+                    char * bytes = reinterpret_cast<char *>(&client.request);
+                    ssize_t result = ::recv(client.fd,
+                        bytes + client.received,
+                        sizeof(client.request) - client.received,
+                        MSG_DONTWAIT);
+                    if (result > 0) {
+                        client.received += result;
+                    } else if (result == 0 || (errno != EAGAIN &&
+                            errno != EWOULDBLOCK && errno != EINTR)) {
+                        // The client went away before sending its request.
+                        ::close(client.fd);
+                        closed = true;
+                    }
+                }
+
+                if (closed) {
+                    continue;
+                }
+                if (client.received == sizeof(client.request)) {
+                    this->dispatch_request(client.fd, client.request,
+                        client.accepted_us);
+                } else if (now_us - client.accepted_us >=
+                        SERVICE_REQUEST_TIMEOUT_US) {
+                    ::close(client.fd);
+                } else {
+                    pending[kept++] = client;
+                }
+            }
+            pending.resize(kept);
+
+            if (ready > 0 && (poll_fds[0].revents & POLLIN) != 0) {
+                int fd = ::accept(this->listen_fd, nullptr, nullptr);
+                if (fd >= 0) {
+                    PendingRequest client;
+                    std::memset(&client, 0, sizeof(client));
+                    client.fd = fd;
+                    client.accepted_us = now_us;
+                    pending.push_back(client);
+                }
+            }
+        }
+
+        for (const auto & client : pending) {
+            ::close(client.fd);
+        }
+    }
+
+    /**
+     * Answers a fully received request, or queues it if it is a job.
+     */
+    void Service::dispatch_request(const int fd, ServiceRequest request,
+            const std::uint64_t accepted_us) {
+        try {
+            if (request.type ==
+                    static_cast<std::uint32_t>(RequestType::STATS)) {
+                ServiceStats stats = this->stats();
+                send_message(fd, &stats, sizeof(stats));
+                ::close(fd);
+                return;
+            }
+
+            if (request.type ==
+                    static_cast<std::uint32_t>(RequestType::RELEASE)) {
+                ServiceResponse response;
+                std::memset(&response, 0, sizeof(response));
+                request.shm_name[sizeof(request.shm_name) - 1] = '\0';
+                if (this->release_segment(request.shm_name, request.lease)) {
+                    response.status = static_cast<std::uint32_t>(
+                        ServiceStatus::OK);
+                } else {
+                    response.status = static_cast<std::uint32_t>(
+                        ServiceStatus::ERROR);
+                    std::strncpy(response.message,
+                        "Output segment is not leased under this token.",
+                        sizeof(response.message) - 1);
+                }
+                send_message(fd, &response, sizeof(response));
+                ::close(fd);
+                return;
+            }
+
+            bool accepted;
+            {
+                std::lock_guard<std::mutex> lock(this->stats_mutex);
+                accepted = this->num_queued < this->options.max_queued_jobs;
+                if (accepted) {
+                    this->num_queued++;
+                } else {
+                    this->num_rejected++;
+                }
+            }
+
+            if (!accepted) {
+                ServiceResponse response;
+                std::memset(&response, 0, sizeof(response));
+                response.status = static_cast<std::uint32_t>(
+                    ServiceStatus::BUSY);
+                std::strncpy(response.message, "Job queue is full.",
+                    sizeof(response.message) - 1);
+                send_message(fd, &response, sizeof(response));
+                ::close(fd);
+                return;
+            }
+
+            this->jobs.queue_task([this, fd, request, accepted_us]() {
+                this->handle_job(fd, request, accepted_us);
+            });
+        } catch (const std::exception &) {
+            // The client went away before reading the answer.
+            ::close(fd);
+        }
+    }
+
+    void Service::stop() {
+        this->running = false;
+    }
+
+    ServiceStats Service::stats() {
+        ServiceStats stats;
+        std::memset(&stats, 0, sizeof(stats));
+
+        std::vector<std::uint64_t> latencies;
+        {
+            std::lock_guard<std::mutex> lock(this->stats_mutex);
+            stats.completed = this->num_completed;
+            stats.rejected = this->num_rejected;
+            stats.failed = this->num_failed;
+            stats.running = this->num_running;
+            stats.queued = this->num_queued;
+            latencies.assign(this->latencies.begin(), this->latencies.end());
+        }
+
+        if (!latencies.empty()) {
+            std::sort(latencies.begin(), latencies.end());
+            std::uint64_t total = 0;
+            for (auto latency : latencies) {
+                total += latency;
+            }
+
+            std::size_t last = latencies.size() - 1;
+            stats.latency_mean_us = total / latencies.size();
+            stats.latency_p50_us = latencies[last / 2];
+            stats.latency_p99_us = latencies[last * 99 / 100];
+            stats.latency_max_us = latencies[last];
+        }
+
+        return stats;
+    }
+
+    void Service::handle_job(const int fd, const ServiceRequest request,
+            const std::uint64_t accepted_us) {
+        {
+            std::lock_guard<std::mutex> lock(this->stats_mutex);
+            this->num_queued--;
+            this->num_running++;
+        }
+
+        std::uint64_t started_us = service_clock_us();
+        ServiceResponse response = this->process(request);
+        std::uint64_t finished_us = service_clock_us();
+
+        response.queue_us = started_us - accepted_us;
+        response.process_us = finished_us - started_us;
+
+        bool ok = response.status ==
+            static_cast<std::uint32_t>(ServiceStatus::OK);
+        try {
+            send_message(fd, &response, sizeof(response));
+        } catch (const std::exception &) {
+            // Nobody will pick up the results, so take the segment back.
+            if (ok) {
+                this->release_segment(response.shm_name, response.lease);
+            }
+            ok = false;
+        }
+        ::close(fd);
+
+        std::lock_guard<std::mutex> lock(this->stats_mutex);
+        this->num_running--;
+        if (ok) {
+            this->num_completed++;
+            this->latencies.push_back(finished_us - accepted_us);
+            if (this->latencies.size() > SERVICE_LATENCY_WINDOW) {
+                this->latencies.pop_front();
+            }
+        } else {
+            this->num_failed++;
+        }
+    }
+
+    /**
+     * Downsamples the image in the requested shared memory segment and
+     * writes every level into a new segment.
+     */
+    ServiceResponse Service::process(const ServiceRequest & request) {
+        ServiceResponse response;
+        std::memset(&response, 0, sizeof(response));
+
+        try {
+            if (request.type !=
+                    static_cast<std::uint32_t>(RequestType::PROCESS)) {
+                throw std::invalid_argument("Unknown request type.");
+            }
+            if (request.num_dims == 0 ||
+                    request.num_dims > SERVICE_MAX_DIMS) {
+                throw std::invalid_argument("Unsupported number of "
+                    "dimensions.");
+            }
+            if (std::memchr(request.shm_name, '\0',
+                    sizeof(request.shm_name)) == nullptr) {
+                throw std::invalid_argument("Shared memory name is not "
+                    "terminated.");
+            }
+
+            std::vector<std::size_t> shape(request.num_dims);
+            std::size_t num_elements = 1;
+            for (std::size_t i = 0; i < request.num_dims; i++) {
+                shape[i] = request.shape[i];
+                if (shape[i] < 2 || (shape[i] & (shape[i] - 1)) != 0) {
+                    throw std::invalid_argument("Every dimension must be a "
+                        "power of 2.");
+                }
+                num_elements *= shape[i];
+            }
+
+            // Convert straight from the client's segment into Morton order.
+            std::unique_ptr<Buffers> buffers = this->acquire_buffers();
+            {
+                SharedMemory input(request.shm_name,
+                    num_elements * sizeof(image_data_t), false);
+                buffers->img.assign(
+                    static_cast<const image_data_t *>(input.data), shape);
+            }
+
+            downsample_morton(buffers->img, buffers->levels, this->engine);
+
+            std::size_t output_bytes = 0;
+            for (const auto & level : buffers->levels) {
+                output_bytes += level.data.size() * sizeof(image_data_t);
+            }
+
+            SharedMemory & output = this->lease_segment(output_bytes,
+                response.lease);
+
+            image_data_t * output_data =
+                static_cast<image_data_t *>(output.data);
+            for (const auto & level : buffers->levels) {
+                level.write_row_major(output_data);
+                output_data += level.data.size();
+            }
+
+            this->release_buffers(std::move(buffers));
+
+            response.status = static_cast<std::uint32_t>(ServiceStatus::OK);
+            response.num_levels = find_level_shapes(shape).size();
+            response.output_bytes = output_bytes;
+            std::strncpy(response.shm_name, output.name.c_str(),
+                sizeof(response.shm_name) - 1);
+        } catch (const std::exception & e) {
+            response.status = static_cast<std::uint32_t>(ServiceStatus::ERROR);
+            std::strncpy(response.message, e.what(),
+                sizeof(response.message) - 1);
+        }
+
+        return response;
+    }
+
+    std::unique_ptr<Service::Buffers> Service::acquire_buffers() {
+        std::lock_guard<std::mutex> lock(this->buffers_mutex);
+        if (this->free_buffers.empty()) {
+            return std::unique_ptr<Buffers>(new Buffers());
+        }
+
+        std::unique_ptr<Buffers> buffers = std::move(this->free_buffers.back());
+        this->free_buffers.pop_back();
+
+        return buffers;
+    }
+
+    void Service::release_buffers(std::unique_ptr<Buffers> buffers) {
+        std::lock_guard<std::mutex> lock(this->buffers_mutex);
+        this->free_buffers.push_back(std::move(buffers));
+    }
+
+    /**
+     * Leases an output segment of at least the given size, reusing a
+     * released one of similar size where possible. Reused segments stay
+     * mapped, so their pages are already faulted in.
+     *
+     * Every lease gets a fresh random token, which is required to release
+     * the segment again.
+     */
+    SharedMemory & Service::lease_segment(const std::size_t bytes,
+            std::uint64_t & token) {
+        std::unique_ptr<SharedMemory> segment;
+        {
+            std::lock_guard<std::mutex> lock(this->segments_mutex);
+            auto it = this->free_segments.lower_bound(bytes);
+            if (it != this->free_segments.end() && it->first <= 2 * bytes) {
+                segment = std::move(it->second);
+                this->free_segments.erase(it);
+            }
+        }
+
+        if (!segment) {
+            std::string name = "/eye-" + std::to_string(::getpid()) + "-" +
+                std::to_string(this->job_counter++);
+            segment.reset(new SharedMemory(name, bytes, true));
+        }
+
+        std::random_device random;
+        token = (static_cast<std::uint64_t>(random()) << 32) ^ random();
+
+        std::lock_guard<std::mutex> lock(this->segments_mutex);
+        SharedMemory & leased = *segment;
+        this->leased_segments[leased.name] = Lease{ token,
+            std::move(segment) };
+
+        return leased;
+    }
+
+    /**
+     * Returns a leased output segment to the pool, or removes it if the pool
+     * is full. Returns false unless the segment is leased under the given
+     * token.
+     */
+    bool Service::release_segment(const std::string & name,
+            const std::uint64_t token) {
+        std::lock_guard<std::mutex> lock(this->segments_mutex);
+        auto it = this->leased_segments.find(name);
+        if (it == this->leased_segments.end() || it->second.token != token) {
+            return false;
+        }
+
+        std::unique_ptr<SharedMemory> segment =
+            std::move(it->second.segment);
+        this->leased_segments.erase(it);
+
+        if (this->free_segments.size() < SERVICE_MAX_FREE_SEGMENTS) {
+            std::size_t bytes = segment->bytes;
+            this->free_segments.emplace(bytes, std::move(segment));
+        } else {
+            segment->unlink();
+        }
+
+        return true;
+    }
+
+    /**
+     * Sends a request to the service and waits for its response.
+     */
+    template<typename R>
+    R exchange(const std::string & socket_path,
+            const ServiceRequest & request) {
+        sockaddr_un address = service_address(socket_path);
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0) {
+            throw std::runtime_error("Cannot create service socket.");
+        }
+
+        R response;
+        try {
+            if (::connect(fd, reinterpret_cast<sockaddr *>(&address),
+                    sizeof(address)) != 0) {
+                throw std::runtime_error("Cannot connect to service at " +
+                    socket_path + ".");
+            }
+            send_message(fd, &request, sizeof(request));
+            receive_message(fd, &response, sizeof(response));
+        } catch (...) {
+            ::close(fd);
+            throw;
+        }
+        ::close(fd);
+
+        return response;
+    }
+
+    /**
+     * Asks the service to downsample the row-major image held in the named
+     * shared memory segment.
+     */
+    ServiceResponse submit_job(const std::string & socket_path,
+            const std::string & shm_name,
+            const std::vector<std::size_t> & shape) {
+        if (shape.size() > SERVICE_MAX_DIMS) {
+            throw std::invalid_argument("Too many dimensions for the "
+                "service.");
+        }
+        if (shm_name.size() >= SERVICE_NAME_BYTES) {
+            throw std::invalid_argument("Shared memory name " + shm_name +
+                " is too long.");
+        }
+
+        ServiceRequest request;
+        std::memset(&request, 0, sizeof(request));
+        request.type = static_cast<std::uint32_t>(RequestType::PROCESS);
+        request.num_dims = shape.size();
+        for (std::size_t i = 0; i < shape.size(); i++) {
+            request.shape[i] = shape[i];
+        }
+        std::strcpy(request.shm_name, shm_name.c_str());
+
+        return exchange<ServiceResponse>(socket_path, request);
+    }
+
+    /**
+     * Hands the output segment of a job back to the service once the client
+     * is done reading it.
+     */
+    ServiceResponse release_output(const std::string & socket_path,
+            const ServiceResponse & output) {
+        ServiceRequest request;
+        std::memset(&request, 0, sizeof(request));
+        request.type = static_cast<std::uint32_t>(RequestType::RELEASE);
+        request.lease = output.lease;
+        std::memcpy(request.shm_name, output.shm_name,
+            sizeof(request.shm_name));
+
+        return exchange<ServiceResponse>(socket_path, request);
+    }
+
+    ServiceStats query_stats(const std::string & socket_path) {
+        ServiceRequest request;
+        std::memset(&request, 0, sizeof(request));
+        request.type = static_cast<std::uint32_t>(RequestType::STATS);
+
+        return exchange<ServiceStats>(socket_path, request);
+    }
+}
@@ -0,0 +1,38 @@
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <eye/service.hpp>
+
+namespace {
+    eye::Service * active_service = nullptr;
+
+    void handle_signal(int) {
+        if (active_service != nullptr) {
+            active_service->stop();
+        }
+    }
+}
+
+int main(int argc, char * argv[]) {
+    eye::ServiceOptions options;
+    if (argc > 1) {
+        options.socket_path = argv[1];
+    }
+    if (argc > 2) {
+        options.max_running_jobs = std::stoul(argv[2]);
+    }
+
+    eye::Service service(options);
+    active_service = &service;
+    std::signal(SIGINT, handle_signal);
+    std::signal(SIGTERM, handle_signal);
+
+    std::cout << "Listening on " << options.socket_path << std::endl;
+    service.run();
+
+    eye::ServiceStats stats = service.stats();
+    std::cout << "Completed " << stats.completed << " jobs, rejected " <<
+        stats.rejected << ", failed " << stats.failed << std::endl;
+
+    return 0;
+}